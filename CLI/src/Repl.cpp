@@ -131,7 +131,26 @@ static int lua_collectgarbage(lua_State* L)
         return 1;
     }
 
-    luaL_error(L, "collectgarbage must be called with 'count' or 'collect'");
+    if (strcmp(option, "generational") == 0 || strcmp(option, "incremental") == 0)
+    {
+        int generational = lua_gc(L, LUA_GCSETGENERATIONAL, strcmp(option, "generational") == 0);
+        lua_pushstring(L, generational ? "generational" : "incremental");
+        return 1;
+    }
+
+    if (strcmp(option, "backgroundsweep") == 0 || strcmp(option, "foregroundsweep") == 0)
+    {
+        int background = lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, strcmp(option, "backgroundsweep") == 0);
+        if (background < 0)
+            luaL_error(L, "background sweeper could not be started");
+
+        lua_pushstring(L, background ? "backgroundsweep" : "foregroundsweep");
+        return 1;
+    }
+
+    luaL_error(
+        L, "collectgarbage must be called with 'count', 'collect', 'generational', 'incremental', 'backgroundsweep' or 'foregroundsweep'"
+    );
 }
 
 #ifdef CALLGRIND
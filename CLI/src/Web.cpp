@@ -8,6 +8,7 @@
 #include "luacode.h"
 #include "lstate.h"
 #include "lobject.h"
+#include "lbuffer.h"
 #include "ludata.h"
 
 #include "Luau/Common.h"
@@ -16,18 +17,63 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include <string.h>
 
+#include <algorithm>
+#include <list>
 #include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 #include <iomanip>
 
+struct WebState;
+
 typedef struct
 {
-    const char* ref;
+    int32_t ref;  // jsValueCache id, released from js once the last userdata for it is collected
+    WebState* ws; // owning sandbox, the collecting thread may belong to another sandbox of the same template
 } jsref_ud;
 
+// binary value layout shared with js through the wasm heap, see Module.readWebValue and Module.writeWebValue
+enum WebValueTag
+{
+    WEBVALUE_NIL = 0,
+    WEBVALUE_BOOLEAN = 1,
+    WEBVALUE_NUMBER = 2,
+    WEBVALUE_STRING = 3,
+    WEBVALUE_LTABLE = 4,
+    WEBVALUE_LFUNCTION = 5,
+    WEBVALUE_LUSERDATA = 6,
+    WEBVALUE_LTHREAD = 7,
+    WEBVALUE_LBUFFER = 8,
+    WEBVALUE_JOBJECT = 9,
+    WEBVALUE_JFUNCTION = 10,
+    WEBVALUE_JSYMBOL = 11,
+    WEBVALUE_ERROR = 12, // string payload, only produced for failed calls
+
+    // table snapshots only: len array items follow, then ref key/value pairs
+    WEBVALUE_SNAPSHOT_TABLE = 13,
+    // table snapshots only: ref is the position of an enclosing or earlier table in the same snapshot
+    WEBVALUE_SNAPSHOT_CYCLE = 14,
+};
+
+struct WebValue
+{
+    uint8_t tag;
+    uint32_t len; // byte length of str, array item count of snapshot tables
+    union
+    {
+        double number;
+        int32_t boolean;
+        int32_t ref; // registry ref for lua values, jsref id for js values
+        const char* str;
+    };
+};
+
+static_assert(sizeof(WebValue) == 16, "WebValue layout is mirrored in js and must stay 16 bytes");
+
 void fprint(const char* fmt, ...)
 {
     va_list args;
@@ -58,60 +104,211 @@ void fprintwarn(const char* fmt, ...)
     va_end(args);
 }
 
-static std::unordered_map<lua_State*, int> emEnvMap;
-static std::unordered_map<lua_State*, int> emGlobalsMap;
-static std::unordered_map<lua_State*, int> emFakeGlobalsMap;
-static std::unordered_map<const void*, int> refCache;
-static std::unordered_map<const void*, std::string> jsfuncClosureMap;
+// bytes held by one lua_newstate, standalone states own theirs and forked sandboxes share the template one
+struct WebAllocator
+{
+    size_t current = 0;
+    size_t peak = 0;
+    size_t limit = 0; // allocations past this fail with "not enough memory", 0 for none
+
+    // the template allocator also holds each forked sandbox to the budget of its memory category; allocations are
+    // charged to the category of the sandbox running lua at the time, see ScopedLuaSlice
+    global_State* global = nullptr;
+    int activeMemcat = 0;
+    size_t memcatLimit[LUA_MEMORY_CATEGORIES] = {};
+    size_t memcatPeak[LUA_MEMORY_CATEGORIES] = {};
+};
+
+// shared by the template state and every sandbox forked from it, see LUA_TEMPLATE_STATE
+static WebAllocator templateAllocator;
+
+// interop bookkeeping for one sandbox, reached through the thread data of forked sandboxes (inherited by their
+// coroutines) or through lua_callbacks(L)->userdata for standalone states
+struct WebState
+{
+    int envId = -1;
+    int globalsRef = LUA_NOREF;
+    int fakeGlobalsRef = LUA_NOREF;
+    int threadRef = LUA_NOREF; // anchors sandboxes forked from the template state
+    int propertyCacheRef = LUA_NOREF; // jsref id -> { key -> primitive value } for immutable js objects
+    bool loading = false;
+    bool closed = false;       // freed by the last jsref destructor when set, see jsrefDestructor
+    bool bytecodeOnly = false; // luauLoad refuses source, see LUA_BYTECODE_ONLY
+    bool cooperative = false;  // js->lua calls run on call threads, see LUA_COOPERATIVE_SCHEDULER
+
+    int optimizationLevel = 1;
+    int debugLevel = 1;
+
+    double budgetMs = 0;       // lua time allowed per slice, 0 for none, see setExecutionBudget
+    bool budgetYield = false;  // call threads yield back to js instead of erroring once the slice runs out
+    int sliceDepth = 0;        // nested entries into lua, the slice spans the outermost one
+    int interruptCount = 0;    // interrupts since the clock was last read
+    double sliceStart = 0;     // emscripten_get_now() when the current slice started
+    double executionTime = 0;  // ms spent in lua over the life of the state, see getExecutionTime
+
+    WebAllocator allocator;    // used by standalone states, see webAlloc
+    size_t memoryLimit = 0;    // bytes the sandbox may hold, see setMemoryLimit
+    int memcat = 0;            // memory category of forked sandboxes, 0 for standalone states
+
+    std::vector<int> keyRefs;  // key id -> registry ref of its interned string, see pushKey
+
+    std::unordered_map<const void*, int> refCache; // registry refs of values sent to js
+    std::unordered_map<int, int> jsrefCounts;      // live userdata per jsValueCache id
+    std::unordered_set<lua_State*> callThreads;    // threads started by luaNewCallThread that have not finished
+    std::vector<int> stalePropertyCaches;          // jsref ids collected since the last purge, see cacheProperty
+};
+
+// outlives the states it was filled by, luauClose flushes it once the state is gone
+static std::vector<int32_t> pendingJSReleases; // (envId, jsref id) pairs
+
+const size_t kJSReleaseBatch = 256;
+
+static WebState* getWebState(lua_State* L)
+{
+    if (WebState* ws = (WebState*)lua_getthreaddata(L))
+        return ws;
+
+    return (WebState*)lua_callbacks(L)->userdata;
+}
+
+static void inheritWebState(lua_State* LP, lua_State* L)
+{
+    if (LP)
+        lua_setthreaddata(L, lua_getthreaddata(LP));
+}
+
+// the clock is a js call, so the interrupt only reads it every this many interrupts
+const int kBudgetCheckInterval = 128;
+
+// a slice runs from js calling into lua until lua returns or waits on js, its time counts against budgetMs and its
+// allocations against the memory category of a forked sandbox
+struct ScopedLuaSlice
+{
+    WebState* ws;
+    int outerMemcat;
+    ScopedLuaSlice(WebState* ws)
+        : ws(ws)
+        , outerMemcat(templateAllocator.activeMemcat)
+    {
+        templateAllocator.activeMemcat = ws->memcat;
+
+        if (ws->sliceDepth++ == 0)
+        {
+            ws->sliceStart = emscripten_get_now();
+            ws->interruptCount = 0;
+        }
+    }
+    ~ScopedLuaSlice()
+    {
+        if (--ws->sliceDepth == 0)
+            ws->executionTime += emscripten_get_now() - ws->sliceStart;
+
+        templateAllocator.activeMemcat = outerMemcat;
+    }
+};
+
+static void webInterrupt(lua_State* L, int gc)
+{
+    if (gc >= 0)
+        return;
+
+    WebState* ws = getWebState(L);
+    if (!ws)
+        return;
+
+    if (ws->budgetMs <= 0 || ws->sliceDepth == 0 || ++ws->interruptCount < kBudgetCheckInterval)
+        return;
+
+    ws->interruptCount = 0;
+    if (emscripten_get_now() - ws->sliceStart < ws->budgetMs)
+        return;
+
+    // Module.runLuaCallThread resumes the thread on a later turn of the event loop with a fresh slice
+    if (ws->budgetYield && ws->callThreads.count(L) && lua_isyieldable(L))
+    {
+        lua_yield(L, 0);
+        return;
+    }
+
+    luaL_error(L, "execution budget of %gms exceeded", ws->budgetMs);
+}
 
 int getPersistentRef(lua_State* L, int index)
 {
+    WebState* ws = getWebState(L);
+
     const void* ptr = lua_topointer(L, index);
-    auto it = refCache.find(ptr);
-    if (it != refCache.end())
+    auto it = ws->refCache.find(ptr);
+    if (it != ws->refCache.end())
         return it->second;
 
     int ref = lua_ref(L, index);
-    refCache[ptr] = ref;
+    ws->refCache[ptr] = ref;
     return ref;
 }
 
 void setEnvId(lua_State* L, int envId)
 {
-    emEnvMap[L] = envId;
+    getWebState(L)->envId = envId;
 }
 
 int getEnvId(lua_State* L)
 {
-    auto it = emEnvMap.find(L);
-    if (it != emEnvMap.end())
-        return it->second;
+    WebState* ws = getWebState(L);
+    return ws ? ws->envId : -1;
+}
+
+int jsfunc_wrapper(lua_State* L);
+static void pushJSRefValue(lua_State* L, int tag, int id, const char* key);
+
+// js functions are pushed as a jsfunc_wrapper closure whose only upvalue is the jsref userdata
+static jsref_ud* getJSFunctionRef(lua_State* L, int index)
+{
+    if (lua_tocfunction(L, index) != jsfunc_wrapper)
+        return nullptr;
+
+    lua_getupvalue(L, index, 1);
+    jsref_ud* ud = (jsref_ud*)lua_touserdatatagged(L, -1, UTAG_JSFUNC);
+    lua_pop(L, 1);
+    return ud;
+}
+
+// clang-format off
+EM_JS(void, releaseJSRefs, (const int32_t* pairs, int count), {
+    for (let i = 0; i < count; i++) {
+        Module.releaseJSRef(HEAP32[(pairs >> 2) + i * 2], HEAP32[(pairs >> 2) + i * 2 + 1]);
+    }
+});
+// clang-format on
+
+// hands js refs released by collected userdata back to js in one call
+static void flushJSReleases()
+{
+    if (pendingJSReleases.empty())
+        return;
 
-    lua_State* M = lua_mainthread(L);
-    it = emEnvMap.find(M);
-    return it != emEnvMap.end() ? it->second : -1;
+    releaseJSRefs(pendingJSReleases.data(), int(pendingJSReleases.size() / 2));
+    pendingJSReleases.clear();
 }
 
-static int saveGlobalsRefToMap(lua_State* L, std::unordered_map<lua_State*, int>& map)
+static int saveGlobalsRef(lua_State* L, int& slot)
 {
-    auto it = map.find(L);
-    if (it != map.end())
-        return it->second;
+    if (slot != LUA_NOREF)
+        return slot;
 
     lua_pushvalue(L, LUA_GLOBALSINDEX);
-    int ref = lua_ref(L, -1);
+    slot = lua_ref(L, -1);
     lua_pop(L, 1);
-    map[L] = ref;
-    return ref;
+    return slot;
 }
 
 int saveOriginalGlobalsRef(lua_State* L)
 {
-    return saveGlobalsRefToMap(L, emGlobalsMap);
+    return saveGlobalsRef(L, getWebState(L)->globalsRef);
 }
 int saveSandboxedGlobalsRef(lua_State* L)
 {
-    return saveGlobalsRefToMap(L, emFakeGlobalsMap);
+    return saveGlobalsRef(L, getWebState(L)->fakeGlobalsRef);
 }
 
 // clang-format off
@@ -125,6 +322,9 @@ EM_JS(void, setEnvFromJS, (int L_ptr, int envId, int globalsRef, int fakeGlobals
         throw new RuntimeError("no state for env id " + envId);
     }
 
+    // refs are released through the main thread, coroutines that created LuaValues may be gone by then
+    Module.interopState(envId).L = L_ptr;
+
     const extraKeys = {
         "global": Module.LuaValue(L_ptr, envId, "ltable", fakeGlobalsRef),
         "istable": function(value) {
@@ -323,6 +523,21 @@ EM_JS(void, ensureInterop, (), {
     Module.RuntimeError = RuntimeError;
     Module.securityTransmitList = Module.securityTransmitList || new Map();
     Module.options = Module.options || new Map();
+    Module.states = Module.states || {};
+
+    // the per-state bookkeeping every interop path reads through Module.states[envId]; makeLuaState creates it
+    // unless the host already did, hosts that need it before that (e.g. to seed transactionData) call this
+    Module.createInteropState = function(envId, nextJSRef = -1) {
+        Module.states[envId] = {
+            luaValueCache: new Map(),
+            transactionData: {},
+            nextTXKey: 1,
+            jsValueCache: new Map(),
+            jsValueReverse: new Map(),
+            nextJSRef,
+        };
+        return Module.states[envId];
+    };
 
     if (!Module._asyncMutex) {
         const needsMutex = typeof WebAssembly.Suspending !== "function" || typeof WebAssembly.promising !== "function";
@@ -388,13 +603,112 @@ EM_JS(void, ensureInterop, (), {
         console.error("\x1b[1;38;5;13m[luau-web] \x1b[38;5;1m[error]\x1b[22m", ...args, "\x1b[0m");
     };
 
+    // cross-heap lifetime: LuaValues dropped by js are unreferenced in batches once collected, see luaUnrefBatch
+    Module.LUA_UNREF_BATCH = 256;
+    if (!Module.luaValueRegistry && typeof FinalizationRegistry === "function" && typeof WeakRef === "function") {
+        Module.luaValueRegistry = new FinalizationRegistry(held => Module.queueLuaUnref(held.stateIdx, held.ref));
+    }
+
+    Module.interopState = function(stateIdx) {
+        const state = Module.states[stateIdx];
+        if (!state.interop) {
+            state.interop = { L: 0, liveLuaValues: 0, pendingUnrefs: new Set(), flushScheduled: false, closed: false };
+        }
+        return state.interop;
+    };
+
+    Module.derefLuaValue = function(entry) {
+        return Module.luaValueRegistry && entry instanceof WeakRef ? entry.deref() : entry;
+    };
+
+    Module.queueLuaUnref = function(stateIdx, ref) {
+        if (!Module.states[stateIdx]) {
+            return;
+        }
+
+        const interop = Module.interopState(stateIdx);
+        if (interop.closed) {
+            return;
+        }
+
+        interop.liveLuaValues--;
+        interop.pendingUnrefs.add(ref);
+
+        if (interop.pendingUnrefs.size >= Module.LUA_UNREF_BATCH) {
+            Module.flushLuaUnrefs(stateIdx);
+        } else if (!interop.flushScheduled) {
+            interop.flushScheduled = true;
+            queueMicrotask(() => Module.flushLuaUnrefs(stateIdx));
+        }
+    };
+
+    Module.flushLuaUnrefs = function(stateIdx) {
+        const state = Module.states[stateIdx];
+        if (!state || !state.interop || state.interop.closed) {
+            return;
+        }
+
+        const interop = state.interop;
+        interop.flushScheduled = false;
+
+        const refs = [];
+        for (const ref of interop.pendingUnrefs) {
+            // the registry ref may have been handed to js again before this flush ran
+            if (Module.derefLuaValue(state.luaValueCache.get(ref))) {
+                continue;
+            }
+            state.luaValueCache.delete(ref);
+            refs.push(ref);
+        }
+        interop.pendingUnrefs.clear();
+
+        if (refs.length == 0) {
+            return;
+        }
+
+        const ptr = _webReserveRefs(refs.length);
+        HEAP32.set(refs, ptr >> 2);
+        _luaUnrefBatch(interop.L, ptr, refs.length);
+    };
+
+    Module.interopStats = function(stateIdx) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        const interop = Module.interopState(stateIdx);
+        const ptr = _getInteropStats(interop.L);
+
+        return {
+            luaToJs: {
+                liveLuaValues: interop.liveLuaValues,
+                pendingUnrefs: interop.pendingUnrefs.size,
+                cachedRefs: HEAP32[(ptr + 12) >> 2],
+            },
+            jsToLua: {
+                jsValues: Module.states[stateIdx].jsValueCache.size,
+                liveRefs: HEAP32[ptr >> 2],
+                liveProxies: HEAP32[(ptr + 4) >> 2],
+                pendingReleases: HEAP32[(ptr + 8) >> 2],
+            },
+            execution: {
+                totalTime: _getExecutionTime(interop.L),
+                lastCallTime: interop.lastCallTime || 0,
+            },
+        };
+    };
+
     Module.LuaValue = function(state, stateIdx, type, ref, extraProps)
     {
-        if (Module.states[stateIdx].luaValueCache.has(ref))
+        const cached = Module.derefLuaValue(Module.states[stateIdx].luaValueCache.get(ref));
+        if (cached)
         {
-            return Module.states[stateIdx].luaValueCache.get(ref);
+            return cached;
         }
 
+        // values can be created while a coroutine or call thread runs, which may be gone by the time they are used
+        state = Module.interopState(stateIdx).L || state;
+
         const obj = {
             [Module.LUA_VALUE]: {
                 ref,
@@ -409,7 +723,15 @@ EM_JS(void, ensureInterop, (), {
                     {
                         return;
                     }
+                    Module.luaValueRegistry?.unregister(this);
+
+                    const cache = Module.states[this.stateIdx]?.luaValueCache;
+                    if (cache && Module.derefLuaValue(cache.get(this.ref)) === luaValue) {
+                        cache.delete(this.ref);
+                    }
+
                     Module.ccall('luaUnref', 'void', [ 'number', 'number' ], [ this.state, this.ref ]);
+                    Module.interopState(this.stateIdx).liveLuaValues--;
                     this.released = true;
                 }
             },
@@ -513,35 +835,53 @@ EM_JS(void, ensureInterop, (), {
             });
         };
 
-        Module.states[stateIdx].luaValueCache.set(ref, luaValue);
+        if (type == "lbuffer") {
+            // luau never moves buffer contents, but growing the wasm memory detaches every view over the old one
+            let region = null;
+            const currentRegion = function() {
+                if (obj[Module.LUA_VALUE].released) {
+                    throw new RuntimeError("buffer was released");
+                }
 
-        return luaValue;
-    };
+                if (!region || region.memory !== HEAPU8.buffer) {
+                    const ptr = _luaBufferRegion(obj[Module.LUA_VALUE].state, obj[Module.LUA_VALUE].ref);
+                    const data = HEAPU32[ptr >> 2];
+                    const length = HEAPU32[(ptr + 4) >> 2];
 
-    Module.callLuaFunction = async function(stateIdx, luaFunction, args) {
-        if (!Module.states[stateIdx]) {
-            throw new RuntimeError("no state for env id " + stateIdx);
-        }
-        
-        const luaFunctionData = luaFunction[Module.LUA_VALUE];
-        
-        if (luaFunctionData.released) {
-            throw new GlueError("attempt to call released function");
-            return;
-        }
+                    region = {
+                        memory: HEAPU8.buffer,
+                        bytes: new Uint8Array(HEAPU8.buffer, data, length),
+                        view: new DataView(HEAPU8.buffer, data, length),
+                    };
+                }
+                return region;
+            };
 
-        const trimmed = args.slice(0, args.findLastIndex(x => x != undefined) + 1);
-        const argDataKey = Module.states[stateIdx].nextTXKey++;
+            Object.defineProperty(obj, "length", { get: () => currentRegion().bytes.length });
+            Object.defineProperty(obj, "bytes", { get: () => currentRegion().bytes });
+            Object.defineProperty(obj, "view", { get: () => currentRegion().view });
+        };
 
-        Module.states[stateIdx].transactionData[argDataKey] = trimmed;
+        if (Module.luaValueRegistry) {
+            Module.luaValueRegistry.register(luaValue, { stateIdx, ref }, obj[Module.LUA_VALUE]);
+            Module.states[stateIdx].luaValueCache.set(ref, new WeakRef(luaValue));
+        } else {
+            Module.states[stateIdx].luaValueCache.set(ref, luaValue);
+        }
+        Module.interopState(stateIdx).liveLuaValues++;
+
+        return luaValue;
+    };
 
+    // runs the call on the calling wasm stack, js awaits suspend it so without jspi calls have to be serialized
+    Module.runLuaPcall = async function(luaFunctionData, argDataKey) {
         if (Module._asyncMutex.enabled && Module._asyncMutex._locked && !Module.warnedConcurrent) {
             Module.fprintwarn("bad state: concurrent lua execution without jspi support, calls will be serialized. see luau-web wiki for details");
             Module.warnedConcurrent = true;
         }
 
         await Module._asyncMutex.acquire();
-        let status;
+        const startTime = _getExecutionTime(luaFunctionData.state);
         try {
             const canUseJSPI =
                 typeof WebAssembly.Suspending === "function" &&
@@ -549,9 +889,9 @@ EM_JS(void, ensureInterop, (), {
                 typeof Module.luaPcall === "function";
 
             if (canUseJSPI) {
-                status = await Module.luaPcall(luaFunctionData.state, luaFunctionData.ref, argDataKey);
+                return await Module.luaPcall(luaFunctionData.state, luaFunctionData.ref, argDataKey);
             } else {
-                status = await Module.ccall(
+                return await Module.ccall(
                     "luaPcall",
                     "number",
                     [ "number", "number", "number" ],
@@ -560,8 +900,148 @@ EM_JS(void, ensureInterop, (), {
                 );
             }
         } finally {
+            Module.recordCallTime(luaFunctionData.stateIdx, () => _getExecutionTime(luaFunctionData.state) - startTime);
             Module._asyncMutex.release();
         }
+    };
+
+    // runs the call on its own lua thread, which yields back here whenever it waits on a js promise;
+    // nothing is suspended on the wasm stack in between, so calls from any number of states interleave freely
+    Module.runLuaCallThread = async function(stateIdx, luaFunctionData, argDataKey) {
+        const state = Module.states[stateIdx];
+        const L = luaFunctionData.state;
+        const threadRef = _luaNewCallThread(L, luaFunctionData.ref);
+
+        // other calls run in between resumes, so only the resumes of this call count towards its time
+        let callTime = 0;
+        const resume = (isError) => {
+            const startTime = _getExecutionTime(L);
+            const status = _luaResumeCall(L, threadRef, argDataKey, isError);
+            callTime += _getExecutionTime(L) - startTime;
+            return status;
+        };
+
+        let status = resume(0);
+
+        while (status == 1) {
+            const pending = state.pendingResult;
+            delete state.pendingResult;
+
+            let isError = 0;
+            try {
+                // without a pending promise this was a plain coroutine.yield or the slice ran out of budget,
+                // either way the event loop gets a turn before the call carries on
+                const results = pending ? await pending : await Module.nextTurn();
+                state.transactionData[argDataKey] = pending ? Module.trimJSResult(results) : [];
+            } catch (e) {
+                if (e instanceof Module.FatalJSError) {
+                    throw e;
+                }
+                state.transactionData[argDataKey] = [ (e && e.toString) ? e.toString() : String(e) ];
+                isError = 1;
+            }
+
+            if (Module.interopState(stateIdx).closed) {
+                throw new LuaError("state was closed while the call was waiting on js");
+            }
+
+            status = resume(isError);
+        }
+
+        Module.recordCallTime(stateIdx, () => callTime);
+        return status;
+    };
+
+    Module.nextTurn = function() {
+        return new Promise(resolve => typeof setImmediate === "function" ? setImmediate(resolve) : setTimeout(resolve, 0));
+    };
+
+    // keeps the lua time of the last call and reports it to LUA_CALL_TIME_CALLBACK(stateIdx, ms) for billing or throttling
+    Module.recordCallTime = function(stateIdx, getTime) {
+        if (!Module.states[stateIdx] || Module.interopState(stateIdx).closed) {
+            return;
+        }
+
+        const time = getTime();
+        Module.interopState(stateIdx).lastCallTime = time;
+
+        const callback = Module.options.get("LUA_CALL_TIME_CALLBACK");
+        if (typeof callback === "function") {
+            callback(stateIdx, time);
+        }
+    };
+
+    // bytes of lua memory the state may hold before allocations fail with "not enough memory", 0 for none
+    Module.setMemoryLimit = function(stateIdx, bytes) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        _setMemoryLimit(Module.interopState(stateIdx).L, bytes);
+    };
+
+    Module.memoryStats = function(stateIdx) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        const ptr = _getMemoryStats(Module.interopState(stateIdx).L) >> 3;
+        const count = HEAPF64[ptr];
+        const values = HEAPF64.subarray(ptr + 1, ptr + 1 + count);
+
+        const categories = {};
+        for (let i = 3; i < count; i += 2) {
+            categories[values[i]] = values[i + 1];
+        }
+
+        return { current: values[0], peak: values[1], limit: values[2], categories };
+    };
+
+    Module.GC_OPERATIONS = { stop: 0, restart: 1, collect: 2, count: 3, step: 6, generational: 10 };
+
+    // "step" runs an incremental step of size kb, "collect" a full cycle, both return what lua_gc returns
+    // "generational" with size 1 switches to generational collection (0 switches back) and returns the previous mode
+    Module.collectGarbage = function(stateIdx, operation = "step", size = 0) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        if (!(operation in Module.GC_OPERATIONS)) {
+            throw new GlueError("unknown gc operation " + operation);
+        }
+
+        return _luaGc(Module.interopState(stateIdx).L, Module.GC_OPERATIONS[operation], size);
+    };
+
+    // ms per slice of lua execution before it errors, or with yield set before call threads yield to the event loop
+    Module.setExecutionBudget = function(stateIdx, ms, { yield: shouldYield = false } = {}) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        _setExecutionBudget(Module.interopState(stateIdx).L, ms, shouldYield ? 1 : 0);
+    };
+
+    Module.callLuaFunction = async function(stateIdx, luaFunction, args) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+        
+        const luaFunctionData = luaFunction[Module.LUA_VALUE];
+        
+        if (luaFunctionData.released) {
+            throw new GlueError("attempt to call released function");
+            return;
+        }
+
+        const trimmed = args.slice(0, args.findLastIndex(x => x != undefined) + 1);
+        const argDataKey = Module.states[stateIdx].nextTXKey++;
+
+        Module.states[stateIdx].transactionData[argDataKey] = trimmed;
+
+        const status = Module.options.get("LUA_COOPERATIVE_SCHEDULER")
+            ? await Module.runLuaCallThread(stateIdx, luaFunctionData, argDataKey)
+            : await Module.runLuaPcall(luaFunctionData, argDataKey);
 
         const multretData = Module.states[stateIdx].transactionData[argDataKey];
         delete Module.states[stateIdx].transactionData[argDataKey];
@@ -570,6 +1050,10 @@ EM_JS(void, ensureInterop, (), {
             throw new LuaError(multretData[0] ? multretData[0].error : "No output from Luau");
         }
 
+        if (!Module.jsonMarshalling) {
+            return multretData;
+        }
+
         const argData = multretData.map(v => Module.luauToJsValue(stateIdx, luaFunctionData.state, v));
 
         return argData;
@@ -583,13 +1067,25 @@ EM_JS(void, ensureInterop, (), {
             return;
         }
 
-        const [type, value] = Module.jsToLuauValue(stateIdx, null, key);
-
-        const transactionIdx = Module.ccall("luaIndex", "number", [ "number", "number", "string", "string" ], [ luaTableData.state, luaTableData.ref, type, value ]);
+        const keyId = Module.keyId(key);
+        let transactionIdx;
+        if (keyId) {
+            transactionIdx = _luaIndexById(luaTableData.state, luaTableData.ref, keyId);
+        } else if (!Module.jsonMarshalling) {
+            Module.writeWebValues(stateIdx, [ key ], "<indexarg>");
+            transactionIdx = _luaIndexValue(luaTableData.state, luaTableData.ref);
+        } else {
+            const [type, value] = Module.jsToLuauValue(stateIdx, null, key);
+            transactionIdx = Module.ccall("luaIndex", "number", [ "number", "number", "string", "string" ], [ luaTableData.state, luaTableData.ref, type, value ]);
+        }
 
         const transactionData = Module.states[stateIdx].transactionData[transactionIdx];
         delete Module.states[stateIdx].transactionData[transactionIdx];
 
+        if (!Module.jsonMarshalling) {
+            return transactionData;
+        }
+
         const luauValue = Module.luauToJsValue(stateIdx, luaTableData.state, transactionData);
 
         return luauValue
@@ -607,10 +1103,19 @@ EM_JS(void, ensureInterop, (), {
             return;
         }
 
-        const [KT, KV] = Module.jsToLuauValue(stateIdx, null, key);
-        const [VT, VV] = Module.jsToLuauValue(stateIdx, null, value);
-
-        const modified = Module.ccall("luaNewIndex", "number", [ "number", "number", "string", "string", "string", "string", "boolean" ], [ luaTableData.state, luaTableData.ref, KT, KV, VT, VV, bypassReadonly ]);
+        const keyId = Module.keyId(key);
+        let modified;
+        if (keyId) {
+            Module.writeWebValues(stateIdx, [ value ], key);
+            modified = _luaNewIndexById(luaTableData.state, luaTableData.ref, keyId, bypassReadonly ? 1 : 0);
+        } else if (!Module.jsonMarshalling) {
+            Module.writeWebValues(stateIdx, [ key, value ], key);
+            modified = _luaNewIndexValue(luaTableData.state, luaTableData.ref, bypassReadonly ? 1 : 0);
+        } else {
+            const [KT, KV] = Module.jsToLuauValue(stateIdx, null, key);
+            const [VT, VV] = Module.jsToLuauValue(stateIdx, null, value);
+            modified = Module.ccall("luaNewIndex", "number", [ "number", "number", "string", "string", "string", "string", "boolean" ], [ luaTableData.state, luaTableData.ref, KT, KV, VT, VV, bypassReadonly ]);
+        }
 
         if (!bypassReadonly && !modified && !Module.options.get("LUA_NONSTRICT_READONLY")) {
             throw new LuaError("attempt to modify a readonly table");
@@ -619,33 +1124,141 @@ EM_JS(void, ensureInterop, (), {
         return modified == 1;
     };
 
-    Module.keysLuaTable = function(stateIdx, luaTable) {
-        const luaTableData = luaTable[Module.LUA_VALUE];
+    Module.KEY_ID_LIMIT = 4096;
+    Module.keyIds = new Map();
 
-        if (luaTableData.released) {
-            throw new GlueError("attempt to get keys from released table");
-            return;
+    // small integer standing for a string key, registered with wasm the first time the name is seen; 0 when the key
+    // has to go through the string path, i.e. it is not a string, json marshalling is on or the table is full
+    Module.keyId = function(key) {
+        if (typeof key !== "string" || Module.jsonMarshalling) {
+            return 0;
         }
 
-        const argIdx = Module.states[stateIdx].nextTXKey++;
+        let id = Module.keyIds.get(key);
+        if (id === undefined) {
+            if (Module.keyIds.size >= Module.KEY_ID_LIMIT) {
+                return 0;
+            }
 
-        Module.ccall("luaKeys", "number", [ "number", "number", "number" ], [ luaTableData.state, luaTableData.ref, argIdx ]);
+            id = Module.ccall("registerKey", "number", [ "string", "number" ], [ key, lengthBytesUTF8(key) ]);
+            Module.keyIds.set(key, id);
+        }
+        return id;
+    };
 
-        const transactionData = Module.states[stateIdx].transactionData[argIdx];
-        delete Module.states[stateIdx].transactionData[argIdx];
+    // cacheKey -> cache id of the environment tables shared by forked sandboxes, see Module.releaseEnvironment
+    Module.environmentCache = new Map();
+    Module.nextEnvironmentId = 1;
+
+    // installs every entry of env as a global with one call into wasm. the entries land in a presized table the
+    // sandbox globals fall back to, so scripts still shadow them with their own globals. freeze makes the table
+    // readonly; a string cacheKey (forked sandboxes only) builds one frozen table from env on the first install and
+    // hands that same table to every later install with the key, until Module.releaseEnvironment(cacheKey)
+    Module.installEnvironment = function(stateIdx, env, { freeze = false, cacheKey = undefined } = {}) {
+        const L = Module.interopState(stateIdx).L;
+        const entries = Object.entries(env);
+        const keyIds = entries.map(([key]) => Module.keyId(key));
+
+        // keys without an id (json marshalling or a full key table) are written as strings in front of the values
+        const byId = !keyIds.includes(0);
+
+        let cacheId = 0;
+        if (typeof cacheKey === "string" && Module.options.get("LUA_TEMPLATE_STATE")) {
+            cacheId = Module.environmentCache.get(cacheKey);
+            if (cacheId !== undefined) {
+                _installEnvironment(L, 0, 0, 1, cacheId);
+                return;
+            }
 
-        const luauValue = transactionData.map(v => Module.luauToJsValue(stateIdx, luaTableData.state, v));
+            cacheId = Module.nextEnvironmentId++;
+            Module.environmentCache.set(cacheKey, cacheId);
+        }
 
-        return luauValue;
+        const values = entries.map(([key, value]) => value);
+        Module.writeWebValues(cacheId ? Module.sharedEnvState() : stateIdx, byId ? values : entries.map(([key]) => key).concat(values), "<env>");
+
+        let ptr = 0;
+        if (byId) {
+            ptr = _webReserveRefs(keyIds.length);
+            HEAP32.set(keyIds, ptr >> 2);
+        }
+        _installEnvironment(L, ptr, entries.length, freeze || cacheId ? 1 : 0, cacheId);
     };
 
-    Module.getPersistentRef = function(stateIdx, jsValue, parent, key) {
-        if (!Module.states[stateIdx]) {
-            throw new RuntimeError("no state for env id " + stateIdx);
+    // forgets the shared table of cacheKey so the next install builds a new one, e.g. after the env changed;
+    // sandboxes that already installed it keep it until they are closed
+    Module.releaseEnvironment = function(cacheKey) {
+        const cacheId = Module.environmentCache.get(cacheKey);
+        if (cacheId === undefined) {
+            return false;
         }
 
-        if (Module.securityTransmitList.has(jsValue)) {
-            Module.fprintwarn("illegal state: can't get persistent ref, js value '%s' is blocked", key ? String(key) : "unknown");
+        Module.environmentCache.delete(cacheKey);
+        _releaseEnvironment(cacheId);
+        return true;
+    };
+
+    // sets a global of the state, pushGlobalToLua with the key id and binary value paths when they apply
+    Module.setLuaGlobal = function(stateIdx, key, value) {
+        const L = Module.interopState(stateIdx).L;
+        const keyId = Module.keyId(key);
+
+        if (!keyId && !Module.jsonMarshalling) {
+            Module.writeWebValues(stateIdx, [ key, value ], key);
+            _setGlobalValue(L);
+            return;
+        }
+
+        if (!keyId) {
+            const [type, data] = Module.jsToLuauValue(stateIdx, null, value);
+            Module.ccall("pushGlobalToLua", null, [ "number", "string", "string", "string" ], [ L, String(key), type, data ]);
+            return;
+        }
+
+        Module.writeWebValues(stateIdx, [ value ], key);
+        _setGlobalById(L, keyId);
+    };
+
+    Module.keysLuaTable = function(stateIdx, luaTable) {
+        const luaTableData = luaTable[Module.LUA_VALUE];
+
+        if (luaTableData.released) {
+            throw new GlueError("attempt to get keys from released table");
+            return;
+        }
+
+        const argIdx = Module.states[stateIdx].nextTXKey++;
+
+        Module.ccall("luaKeys", "number", [ "number", "number", "number" ], [ luaTableData.state, luaTableData.ref, argIdx ]);
+
+        const transactionData = Module.states[stateIdx].transactionData[argIdx];
+        delete Module.states[stateIdx].transactionData[argIdx];
+
+        if (!Module.jsonMarshalling) {
+            return transactionData;
+        }
+
+        const luauValue = transactionData.map(v => Module.luauToJsValue(stateIdx, luaTableData.state, v));
+
+        return luauValue;
+    };
+
+    // pops the value on top of the lua stack of L_ptr as a js value, see getLuaValue
+    Module.popLuaValue = function(stateIdx, L_ptr) {
+        const key = _getLuaValue(L_ptr, -1);
+        const data = Module.states[stateIdx].transactionData[key];
+        delete Module.states[stateIdx].transactionData[key];
+
+        return Module.jsonMarshalling ? Module.luauToJsValue(stateIdx, L_ptr, JSON.parse(data)) : data;
+    };
+
+    Module.getPersistentRef = function(stateIdx, jsValue, parent, key) {
+        if (!Module.states[stateIdx]) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        if (Module.securityTransmitList.has(jsValue)) {
+            Module.fprintwarn("illegal state: can't get persistent ref, js value '%s' is blocked", key ? String(key) : "unknown");
             return 0;
         }
 
@@ -664,7 +1277,9 @@ EM_JS(void, ensureInterop, (), {
                 release() {
                     if (this.released) return;
                     Module.states[stateIdx].jsValueCache.delete(ref);
-                    Module.states[stateIdx].jsValueReverse.delete(jsValue);
+                    if (Module.states[stateIdx].jsValueReverse.get(jsValue) === ref) {
+                        Module.states[stateIdx].jsValueReverse.delete(jsValue);
+                    }
                     this.released = true;
                 }
             },
@@ -679,6 +1294,35 @@ EM_JS(void, ensureInterop, (), {
         return ref;
     };
 
+    // js values of environments shared by forked sandboxes live in their own cache, see Module.installEnvironment;
+    // their refs are allocated from a separate range so they resolve from any state
+    Module.SHARED_ENV_ID = -2;
+    Module.SHARED_JS_REF_BASE = -(2 ** 30);
+
+    Module.sharedEnvState = function() {
+        if (!Module.states[Module.SHARED_ENV_ID]) {
+            Module.createInteropState(Module.SHARED_ENV_ID, Module.SHARED_JS_REF_BASE);
+        }
+        return Module.SHARED_ENV_ID;
+    };
+
+    Module.jsValueEntry = function(stateIdx, ref) {
+        const state = ref <= Module.SHARED_JS_REF_BASE ? Module.states[Module.SHARED_ENV_ID] : Module.states[stateIdx];
+        return state?.jsValueCache.get(ref);
+    };
+
+    // called once lua has collected the last userdata referencing a js value
+    Module.releaseJSRef = function(stateIdx, ref) {
+        if (!Module.states[stateIdx]) {
+            return;
+        }
+
+        const entry = Module.states[stateIdx].jsValueCache.get(ref);
+        if (entry && Module.safeIn(Module.JS_VALUE, entry)) {
+            entry[Module.JS_VALUE].release();
+        }
+    };
+
     Module.luauToJsValue = function(stateIdx, L_ptr, v)
     {
         if (!Module.states[stateIdx]) {
@@ -717,8 +1361,8 @@ EM_JS(void, ensureInterop, (), {
         case "jsymbol":
         case "jobject":
         case "jfunction":
-            if (typeof v.value == "number" && Module.states[stateIdx].jsValueCache.has(v.value)) {
-                const jsValue = Module.states[stateIdx].jsValueCache.get(v.value);
+            if (typeof v.value == "number" && Module.jsValueEntry(stateIdx, v.value)) {
+                const jsValue = Module.jsValueEntry(stateIdx, v.value);
                 if (jsValue && Module.safeIn(Module.JS_VALUE, jsValue)) {
                     return jsValue[Module.JS_VALUE].value;
                 };
@@ -740,6 +1384,69 @@ EM_JS(void, ensureInterop, (), {
         }
     };
 
+    // allocates a luau buffer js can fill in place through .bytes/.view, e.g. by decoding a frame straight into it
+    Module.createLuaBuffer = function(stateIdx, L_ptr, size) {
+        const ref = _luaNewBuffer(L_ptr, size);
+        if (ref < 0) {
+            throw new RuntimeError("failed to allocate buffer of " + size + " bytes");
+        }
+
+        return Module.LuaValue(L_ptr, stateIdx, "lbuffer", ref);
+    };
+
+    // a js ArrayBuffer cannot be aliased from the wasm heap, so this is a single copy into a new luau buffer
+    Module.toLuaBuffer = function(stateIdx, L_ptr, source) {
+        const bytes = source instanceof ArrayBuffer ? new Uint8Array(source) : new Uint8Array(source.buffer, source.byteOffset, source.byteLength);
+        const buffer = Module.createLuaBuffer(stateIdx, L_ptr, bytes.length);
+        buffer.bytes.set(bytes);
+
+        return buffer;
+    };
+
+    // objects whose primitive properties proxy_index may memoize, in addition to frozen objects under LUA_PROPERTY_CACHE
+    Module.immutableObjects = Module.immutableObjects || new WeakSet();
+
+    Module.markImmutable = function(obj) {
+        Module.immutableObjects.add(obj);
+        return obj;
+    };
+
+    Module.isCacheableProperty = function(obj, key, value) {
+        if (typeof value != "number" && typeof value != "string" && typeof value != "boolean") {
+            return false;
+        }
+
+        if (Module.immutableObjects.has(obj)) {
+            return true;
+        }
+
+        if (!Module.options.get("LUA_PROPERTY_CACHE") || obj instanceof Map || !Object.isFrozen(obj)) {
+            return false;
+        }
+
+        // getters and inherited properties can change even when the object itself is frozen
+        const descriptor = Object.getOwnPropertyDescriptor(obj, key);
+        return descriptor !== undefined && "value" in descriptor;
+    };
+
+    // drops memoized properties of one object, or of every object when value is omitted
+    Module.invalidatePropertyCache = function(stateIdx, value) {
+        const state = Module.states[stateIdx];
+        if (!state) {
+            throw new RuntimeError("no state for env id " + stateIdx);
+        }
+
+        if (value === undefined) {
+            _invalidatePropertyCache(Module.interopState(stateIdx).L, 0);
+            return;
+        }
+
+        const ref = state.jsValueReverse.get(value);
+        if (ref !== undefined) {
+            _invalidatePropertyCache(Module.interopState(stateIdx).L, ref);
+        }
+    };
+
     Module.safeIn = function(inValue, value) {
         try {
             return inValue in value;
@@ -833,232 +1540,636 @@ EM_JS(void, ensureInterop, (), {
         }
 
         const data = value[Module.LUA_VALUE];
-        if (data.type !== "ltable") {
+        if (data.type !== "ltable" || data.released) {
             return value;
         }
 
-        const keys = Module.keysLuaTable(stateIdx, value);
-        if (keys.length === 0) {
-            return value;
-        }
+        // non-empty sequences become arrays, anything else stays the LuaValue it was
+        const result = Module.luaTableSnapshot(stateIdx, L_ptr, value, { arraysOnly: true });
+        return Array.isArray(result) ? result : value;
+    };
 
-        for (const key of keys) {
-            if (typeof key !== "number" || key < 1 || key !== Math.floor(key)) {
-                return value;
-            }
-        }
+    // binary value abi, mirrors struct WebValue: u8 tag, u32 len @ 4, payload @ 8, 16 bytes per value
+    Module.WEB_VALUE_SIZE = 16;
+    Module.WEB_VALUE_TYPES = [ "nil", "boolean", "number", "string", "ltable", "lfunction", "luserdata", "lthread", "lbuffer", "jobject", "jfunction", "jsymbol", "error" ];
+    Module.WEB_VALUE_TAGS = { "ltable": 4, "lfunction": 5, "luserdata": 6, "lthread": 7, "lbuffer": 8 };
+    Module.textDecoder = Module.textDecoder || new TextDecoder("utf-8");
+    Module.textEncoder = Module.textEncoder || new TextEncoder();
+
+    Module.readWebValue = function(stateIdx, L_ptr, ptr) {
+        const tag = HEAPU8[ptr];
 
-        keys.sort((a, b) => a - b);
-        for (let i = 0; i < keys.length; i++) {
-            if (keys[i] !== i + 1) {
-                return value;
+        switch (tag)
+        {
+        case 0:
+            return null;
+        case 1:
+            return HEAP32[(ptr + 8) >> 2] != 0;
+        case 2:
+            return HEAPF64[(ptr + 8) >> 3];
+        case 3:
+        case 12:
+        {
+            const str = HEAPU32[(ptr + 8) >> 2];
+            const len = HEAPU32[(ptr + 4) >> 2];
+            const value = Module.textDecoder.decode(HEAPU8.subarray(str, str + len));
+            return tag == 12 ? { error: value } : value;
+        }
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+            return Module.LuaValue(L_ptr, stateIdx, Module.WEB_VALUE_TYPES[tag], HEAP32[(ptr + 8) >> 2]);
+        case 9:
+        case 10:
+        case 11:
+        {
+            const ref = HEAP32[(ptr + 8) >> 2];
+            const jsValue = Module.jsValueEntry(stateIdx, ref);
+            if (jsValue && Module.safeIn(Module.JS_VALUE, jsValue)) {
+                return jsValue[Module.JS_VALUE].value;
             }
+            Module.fprintwarn(`illegal state: cannot transmit ${Module.WEB_VALUE_TYPES[tag]} invalid ${ref}`);
+            return null;
         }
-
-        const arr = [];
-        for (let i = 1; i <= keys.length; i++) {
-            const val = Module.indexLuaTable(stateIdx, value, i);
-            arr.push(Module.tryConvertLuaTableToArray(stateIdx, L_ptr, val));
+        default:
+            Module.fprintwarn(`illegal l2j conversion: unsupported tag '${tag}', defaulted to null`);
+            return null;
         }
-
-        return arr;
     };
 
-    Module.luaError = function(L_ptr, s) {
-        Module.ccall('pushValueToLuaWrapper', 'void', [ 'number', 'string', 'string', 'string' ], [ L_ptr, 'string', s, `<jserror>` ]);
-        return -1;
-    }
-});
-
-EM_JS(int, getJSProperty, (int L_ptr, int envId, const char* jsRefIdStr, const char* keyCStr), {
-    if (!Module.states[envId]) {
-        throw new RuntimeError("no state for env id " + envId);
-    }
+    Module.readWebValues = function(stateIdx, L_ptr, ptr, count) {
+        const values = new Array(count);
+        for (let i = 0; i < count; i++) {
+            values[i] = Module.readWebValue(stateIdx, L_ptr, ptr + i * Module.WEB_VALUE_SIZE);
+        }
+        return values;
+    };
 
-    const jsRefId = JSON.parse(UTF8ToString(jsRefIdStr));
-    const key = JSON.parse(UTF8ToString(keyCStr));
+    // writes one value at ptr, strings are encoded at strPtr; returns the number of string bytes used
+    Module.writeWebValue = function(stateIdx, ptr, value, key, strPtr) {
+        let tag = 0;
+        let used = 0;
 
-    const data = Module.states[envId].jsValueCache.get(jsRefId);
+        if (Module.securityTransmitList.has(value)) {
+            Module.fprintwarn(`illegal j2l conversion: js value '${key ? String(key) : "unknown"}' is blocked`);
+        } else if (typeof value == "number") {
+            tag = 2;
+            HEAPF64[(ptr + 8) >> 3] = value;
+        } else if (typeof value == "string") {
+            tag = 3;
+            used = Module.textEncoder.encodeInto(value, HEAPU8.subarray(strPtr, strPtr + value.length * 3)).written;
+            HEAPU32[(ptr + 4) >> 2] = used;
+            HEAPU32[(ptr + 8) >> 2] = strPtr;
+        } else if (typeof value == "boolean") {
+            tag = 1;
+            HEAP32[(ptr + 8) >> 2] = value ? 1 : 0;
+        } else if (typeof value == "symbol") {
+            tag = 11;
+            HEAP32[(ptr + 8) >> 2] = Module.getPersistentRef(stateIdx, value, null, key);
+        } else if (value != null && (typeof value == "object" || typeof value == "function")) {
+            if (Module.safeIn(Module.LUA_VALUE, value)) {
+                const data = value[Module.LUA_VALUE];
+                if (!data.released) {
+                    tag = Module.WEB_VALUE_TAGS[data.type];
+                    HEAP32[(ptr + 8) >> 2] = data.ref;
+                } else {
+                    Module.fprintwarn("illegal operation: will not pass released reference");
+                }
+            } else if (Module.safeIn(Module.JS_VALUE, value)) {
+                tag = 9;
+                HEAP32[(ptr + 8) >> 2] = value[Module.JS_VALUE].ref;
+            } else {
+                tag = typeof value == "function" ? 10 : 9;
+                HEAP32[(ptr + 8) >> 2] = Module.getPersistentRef(stateIdx, value, null, key);
+            }
+        } else if (value != null) {
+            Module.fprintwarn(`illegal j2l conversion: unsupported type '${typeof value}', defaulted to nil: ${String(value)}`);
+        }
 
-    if (!data) {
-        throw new GlueError("no data for index, ref " + jsRefId)
-    }
-    
-    if (!data[Module.JS_VALUE]) {
-        Module.fprintwarn("illegal state: js callback on non js data");  
-        return 0;
+        HEAPU8[ptr] = tag;
+        return used;
     };
 
-    if (data[Module.JS_VALUE].released) {
-        Module.fprintwarn("illegal state: lua read on released js data"); 
-        return 0;
-    };
+    // writes values into the shared scratch buffer and returns its address, valid until the next write
+    Module.writeWebValues = function(stateIdx, values, key) {
+        let strBytes = 0;
+        for (const value of values) {
+            if (typeof value == "string") {
+                strBytes += value.length * 3;
+            }
+        }
 
-    const keyData = Module.luauToJsValue(envId, L_ptr, key);
+        const ptr = _webReserveValues(values.length);
+        let strPtr = _webReserveStrings(strBytes);
 
-    const rawVal = data[Module.JS_VALUE].value;
-    if (rawVal instanceof Map) {
-        if (!rawVal.has(keyData)) {
-            Module.ccall('pushValueToLuaWrapper', 'void', ['number', 'string', 'string', 'string'], [L_ptr, 'nil', 'nil', `${keyData}`]);
-            return 1;
+        for (let i = 0; i < values.length; i++) {
+            strPtr += Module.writeWebValue(stateIdx, ptr + i * Module.WEB_VALUE_SIZE, values[i], key, strPtr);
         }
-    }
 
-    const [type, value] = Module.jsToLuauValue(envId, data[Module.JS_VALUE].value, keyData);
+        return ptr;
+    };
 
-    Module.ccall('pushValueToLuaWrapper', 'void', [ 'number', 'string', 'string', 'string' ], [ L_ptr, type, value, `${keyData}` ]);
-    return 1;
+    Module.TABLE_SNAPSHOT_DEPTH = 64;
+    Module.SNAPSHOT_TABLE = Symbol("SnapshotTable");
+    Module.SNAPSHOT_CYCLE = Symbol("SnapshotCycle");
 
-    return 0;
-});
+    // copies a table (and nested tables up to maxDepth) into plain js arrays and objects with one call into wasm
+    Module.luaTableSnapshot = function(stateIdx, L_ptr, value, { maxDepth = Module.TABLE_SNAPSHOT_DEPTH, arraysOnly = false } = {}) {
+        const data = value[Module.LUA_VALUE];
+        const ptr = _luaTableSnapshot(L_ptr, data.ref, maxDepth, arraysOnly ? 1 : 0);
+        return Module.readTableSnapshot(stateIdx, L_ptr, ptr);
+    };
 
-EM_JS(int, setJSProperty, (int L_ptr, int envId, const char* jsRefIdStr, const char* keyCStr, const char* valueCStr), {
-    if (!Module.states[envId]) {
-        throw new RuntimeError("no state for env id " + envId);
-    }
+    // sequences decode to arrays, other tables to objects; cycles decode to the same js object
+    Module.readTableSnapshot = function(stateIdx, L_ptr, ptr) {
+        const tables = new Map();
+        let pos = 0;
 
-    const jsRefId = JSON.parse(UTF8ToString(jsRefIdStr));
-    const key = JSON.parse(UTF8ToString(keyCStr));
-    const value = JSON.parse(UTF8ToString(valueCStr));
+        const read = () => {
+            const at = ptr + pos * Module.WEB_VALUE_SIZE;
+            const tag = HEAPU8[at];
+            pos++;
 
-    const data = Module.states[envId].jsValueCache.get(jsRefId);
+            if (tag == 14) {
+                return tables.get(HEAP32[(at + 8) >> 2]);
+            }
 
-    if (!data) {
-        throw new GlueError("no data for newindex, ref " + jsRefId)
-    }
+            if (tag != 13) {
+                return Module.readWebValue(stateIdx, L_ptr, at);
+            }
 
-    if (!data[Module.JS_VALUE]) {
-        Module.fprintwarn("illegal state: js callback on non js data");  
-        return 0;
-    };
+            const arrayCount = HEAPU32[(at + 4) >> 2];
+            const pairCount = HEAP32[(at + 8) >> 2];
+            const result = pairCount == 0 ? new Array(arrayCount) : {};
+            tables.set(pos - 1, result);
 
-    if (data[Module.JS_VALUE].released) {
-        Module.fprintwarn("illegal state: lua write on released js data"); 
-        return 0;
-    };
+            for (let i = 0; i < arrayCount; i++) {
+                result[pairCount == 0 ? i : i + 1] = read();
+            }
 
-    if (typeof data[Module.JS_VALUE].value !== "object" || !(data[Module.JS_VALUE].value instanceof Map)) {
-        return Module.luaError(L_ptr, "attempt to modify a readonly table");
-    };
+            for (let i = 0; i < pairCount; i++) {
+                const key = read();
+                const item = read();
 
-    if (!data[Module.JS_VALUE].value.has(Module.JS_MUTABLE)) {
-        Module.fprintwarn("illegal state: lua write on non-mutable js data");
-        return Module.luaError(L_ptr, "attempt to modify a readonly table");
-    };
+                if (typeof key == "string" || typeof key == "number" || typeof key == "boolean") {
+                    result[key] = item;
+                } else {
+                    Module.fprintwarn(`illegal l2j conversion: table key of type '${typeof key}' cannot be a js property, skipped`);
+                }
+            }
 
-    try {
-        const keyData = Module.luauToJsValue(envId, L_ptr, key);
-        const valueData = Module.luauToJsValue(envId, L_ptr, value);
+            return result;
+        };
 
-        data[Module.JS_VALUE].value.set(keyData, valueData);
-        return 0;
-    } catch (e) {
-        const errorStr = (e && e.toString) ? e.toString() : String(e);
-        return Module.luaError(L_ptr, errorStr);
-    }
+        return read();
+    };
 
-    return 0;
-});
+    // flattens plain js arrays and objects in the order luaTableFromSnapshot reads them
+    Module.flattenJsTable = function(value, maxDepth) {
+        const items = [];
+        const seen = new Map();
 
-EM_JS(char*, prepareJSKeyList, (int L_ptr, int envId, const char* jsRefIdStr), {
-    if (!Module.states[envId]) {
-        throw new RuntimeError("no state for env id " + envId);
-    }
+        const isPlain = (v) => {
+            if (v === null || typeof v !== "object" || Module.safeIn(Module.LUA_VALUE, v) || Module.safeIn(Module.JS_VALUE, v)) {
+                return false;
+            }
 
-    const jsRefId = JSON.parse(UTF8ToString(jsRefIdStr));
-    const data = Module.states[envId].jsValueCache.get(jsRefId);
+            const proto = Object.getPrototypeOf(v);
+            return Array.isArray(v) || proto === Object.prototype || proto === null;
+        };
 
-    if (!data) {
-        throw new GlueError("no data for keylist, ref " + jsRefId)
-    }
+        const visit = (v, depth) => {
+            if (depth >= maxDepth || !isPlain(v)) {
+                items.push(v);
+                return;
+            }
 
-    if (!data || !data[Module.JS_VALUE] || typeof data[Module.JS_VALUE].value === 'function') {
-        Module.luaError(L_ptr, "attempt to iterate a non-table value");
-        return 0;
-    }
+            if (seen.has(v)) {
+                items.push({ [Module.SNAPSHOT_CYCLE]: seen.get(v) });
+                return;
+            }
 
-    try {
-        let keys = null;
-        if (data[Module.JS_VALUE].value instanceof Map) {
-            keys = Array.from(data[Module.JS_VALUE].value.keys()).filter(k =>
-                k !== Module.LUA_VALUE && k !== Module.JS_VALUE && k !== Module.JS_MUTABLE
-            );
-        } else if (typeof data[Module.JS_VALUE].value === 'object') {
-            keys = Object.keys(data[Module.JS_VALUE].value);
-        }
+            seen.set(v, items.length);
 
-        if (keys) {
-            const keysId = String(jsRefId) + "_keys_" + crypto.randomUUID();
-            
-            Module.states[envId].jsValueCache.set(keysId, {
-                [Module.JS_VALUE]: {
-                    value: keys,
-                    released: false
+            if (Array.isArray(v)) {
+                items.push({ [Module.SNAPSHOT_TABLE]: true, arrayCount: v.length, pairCount: 0 });
+                for (const item of v) {
+                    visit(item, depth + 1);
                 }
-            });
-            
-            const returnStr = JSON.stringify(keysId);
-            const lengthBytes = lengthBytesUTF8(returnStr) + 1;
-            const stringOnWasmHeap = _malloc(lengthBytes);
-            stringToUTF8(returnStr, stringOnWasmHeap, lengthBytes);
-            return stringOnWasmHeap;
-        }
-    } catch (e) {
-        Module.luaError(L_ptr, "JSError: " + e.toString());
-        return 0;
-    }
-
-    Module.luaError(L_ptr, "JSError: unhandled fallthrough in keylist");
-    return 0;
-});
+            } else {
+                const keys = Object.keys(v);
+                items.push({ [Module.SNAPSHOT_TABLE]: true, arrayCount: 0, pairCount: keys.length });
+                for (const key of keys) {
+                    items.push(key);
+                    visit(v[key], depth + 1);
+                }
+            }
+        };
 
-EM_JS(void, releaseJSKeyList, (int envId, const char* keysRefIdStr), {
-    if (!Module.states[envId]) {
-        throw new RuntimeError("no state for env id " + envId);
-    }
+        visit(value, 0);
+        return items;
+    };
 
-    const keysRefId = UTF8ToString(keysRefIdStr);
-    Module.states[envId].jsValueCache.delete(keysRefId);
-});
+    Module.writeTableSnapshot = function(stateIdx, items, key) {
+        let strBytes = 0;
+        for (const item of items) {
+            if (typeof item == "string") {
+                strBytes += item.length * 3;
+            }
+        }
 
-EM_JS(int, getJSIteratorNext, (int L_ptr, int envId, const char* jsRefIdStr, const char* keysRefIdStr, int index), {
-    if (!Module.states[envId]) {
-        throw new RuntimeError("no state for env id " + envId);
-    }
+        const ptr = _webReserveValues(items.length);
+        let strPtr = _webReserveStrings(strBytes);
 
-    const jsRefId = JSON.parse(UTF8ToString(jsRefIdStr));
-    const keysRefId = JSON.parse(UTF8ToString(keysRefIdStr));
-    
-    const objData = Module.states[envId].jsValueCache.get(jsRefId);
-    const keysData = Module.states[envId].jsValueCache.get(keysRefId);
+        for (let i = 0; i < items.length; i++) {
+            const at = ptr + i * Module.WEB_VALUE_SIZE;
+            const item = items[i];
 
-    if (objData && keysData) {
-        const keys = keysData[Module.JS_VALUE].value;
-        if (index >= keys.length) {
-            Module.states[envId].jsValueCache.delete(keysRefId);
-            return 0; 
+            if (item !== null && typeof item == "object" && Module.SNAPSHOT_TABLE in item) {
+                HEAPU8[at] = 13;
+                HEAPU32[(at + 4) >> 2] = item.arrayCount;
+                HEAP32[(at + 8) >> 2] = item.pairCount;
+            } else if (item !== null && typeof item == "object" && Module.SNAPSHOT_CYCLE in item) {
+                HEAPU8[at] = 14;
+                HEAP32[(at + 8) >> 2] = item[Module.SNAPSHOT_CYCLE];
+            } else {
+                strPtr += Module.writeWebValue(stateIdx, at, item, key, strPtr);
+            }
         }
 
-        const currentKey = keys[index];
-
-        Module.ccall('pushValueToLuaWrapper', 'void', ['number', 'string', 'string', 'string'], [L_ptr, 'string', String(currentKey), "jsiter__key"]);
+        return ptr;
+    };
 
-        const [type, value] = Module.jsToLuauValue(envId, objData[Module.JS_VALUE].value, currentKey);
-        
-        const valueStr = String(value);
+    // builds a luau table from a js array or plain object with one call into wasm, tables are presized
+    Module.toLuaTable = function(stateIdx, L_ptr, value, maxDepth = Module.TABLE_SNAPSHOT_DEPTH) {
+        if (!Array.isArray(value) && (value === null || typeof value !== "object")) {
+            throw new RuntimeError("expected an array or object");
+        }
 
-        Module.ccall('pushValueToLuaWrapper', 'void', ['number', 'string', 'string', 'string'], [L_ptr, type, valueStr, "jsiter__value"]);
+        const ptr = Module.writeTableSnapshot(stateIdx, Module.flattenJsTable(value, maxDepth), "<table>");
+        return Module.LuaValue(L_ptr, stateIdx, "ltable", _luaTableFromSnapshot(L_ptr, ptr));
+    };
 
-        return 1;
-    }
+    Module.pushJsString = function(L_ptr, str) {
+        const ptr = _webReserveStrings(str.length * 3);
+        _pushString(L_ptr, ptr, Module.textEncoder.encodeInto(str, HEAPU8.subarray(ptr, ptr + str.length * 3)).written);
+    };
 
-    return 0;
-});
+    // pushes a js value onto the lua stack through the typed entry points, parent is the object value was read from
+    Module.pushJsValue = function(stateIdx, L_ptr, value, parent, key) {
+        if (Module.securityTransmitList.has(value)) {
+            Module.fprintwarn(`illegal j2l conversion: js value '${key ? String(key) : "unknown"}' is blocked`);
+            _pushNil(L_ptr);
+            return;
+        }
 
-// clang-format on
+        switch (typeof value)
+        {
+        case "number":
+            _pushNumber(L_ptr, value);
+            return;
+        case "string":
+            Module.pushJsString(L_ptr, value);
+            return;
+        case "boolean":
+            _pushBool(L_ptr, value ? 1 : 0);
+            return;
+        case "symbol":
+            _pushJsRef(L_ptr, Module.getPersistentRef(stateIdx, value, parent, key), 11, 0);
+            return;
+        case "object":
+        case "function":
+            if (value === null) {
+                break;
+            }
 
-bool isReferenceType(int kind)
-{
+            if (Module.safeIn(Module.LUA_VALUE, value)) {
+                const data = value[Module.LUA_VALUE];
+                if (!data.released) {
+                    _pushRef(L_ptr, data.ref);
+                    return;
+                }
+                Module.fprintwarn("illegal operation: will not pass released reference");
+            } else if (Module.safeIn(Module.JS_VALUE, value)) {
+                _pushJsRef(L_ptr, value[Module.JS_VALUE].ref, 9, 0);
+                return;
+            } else if (typeof value == "function") {
+                const ref = Module.getPersistentRef(stateIdx, value, parent, key);
+                const name = typeof key == "string" ? key : "";
+                const namePtr = _webReserveStrings(name.length * 3 + 1);
+                stringToUTF8(name, namePtr, name.length * 3 + 1);
+                _pushJsRef(L_ptr, ref, 10, namePtr);
+                return;
+            } else {
+                _pushJsRef(L_ptr, Module.getPersistentRef(stateIdx, value, parent, key), 9, 0);
+                return;
+            }
+            break;
+        case "undefined":
+            break;
+        default:
+            Module.fprintwarn(`illegal j2l conversion: unsupported type '${typeof value}', defaulted to nil: ${String(value)}`);
+            break;
+        }
+
+        _pushNil(L_ptr);
+    };
+
+    // returns the list of results, or -1 after pushing an error message with Module.luaError
+    // host functions marked with this symbol are never awaited, even if they return a thenable
+    Module.SYNC_FUNCTION = Symbol("SyncFunction");
+
+    Module.trimJSResult = function(result) {
+        return Array.isArray(result) ? [...result] : [result];
+    };
+
+    // calls a js function without suspending; returns results, -1 with the error pushed, or { pending } for thenables
+    Module.applyJSFunction = function(envId, L_ptr, key, args) {
+        const entry = Module.jsValueEntry(envId, key);
+        if (!entry) {
+            Module.fprintwarn("illegal state: no js function found for path", String(key));
+            return Module.luaError(L_ptr, 'illegal state');
+        }
+
+        const data = entry[Module.JS_VALUE];
+
+        if (!data || !data.value) {
+            Module.fprintwarn("illegal state: no js val found for path", String(key));
+            return Module.luaError(L_ptr, 'illegal state');
+        }
+
+        const func = data.value;
+        let result = null;
+
+        try {
+            const ctx = data.parent?.[Module.JS_VALUE]?.value ?? null;
+
+            try {
+                result = func.apply(ctx, args);
+            } catch (e) {
+                // todo(xNasuni): find better method of detecting constructors, this works though
+                if (e.toString().toLowerCase().includes("constructor") &&
+                    e.toString().toLowerCase().includes("new")) {
+                    result = Reflect.construct(func, args);
+                } else {
+                    throw e;
+                }
+            }
+        } catch (e) {
+            if (e instanceof Module.FatalJSError) {
+                throw e;
+            } else {
+                const errorStr = (e && e.toString) ? e.toString() : String(e);
+                return Module.luaError(L_ptr, errorStr);
+            }
+        }
+
+        // args are not released here since the callee may keep them, Module.luaValueRegistry unrefs them once dropped
+
+        if (!func[Module.SYNC_FUNCTION] && result != null && typeof result === 'object' && typeof result.then === 'function') {
+            return { pending: result };
+        }
+
+        return Module.trimJSResult(result);
+    };
+
+    Module.awaitJSResult = async function(L_ptr, pending) {
+        try {
+            return Module.trimJSResult(await pending);
+        } catch (e) {
+            if (e instanceof Module.FatalJSError) {
+                throw e;
+            }
+            const errorStr = (e && e.toString) ? e.toString() : String(e);
+            return Module.luaError(L_ptr, errorStr);
+        }
+    };
+
+    Module.invokeJSFunction = async function(envId, L_ptr, key, args) {
+        const result = Module.applyJSFunction(envId, L_ptr, key, args);
+        return result?.pending ? Module.awaitJSResult(L_ptr, result.pending) : result;
+    };
+
+    // turns a call result into a transaction key, -1 for errors or -2 when it has to be awaited through awaitJSCall
+    Module.stashJSResult = function(envId, result) {
+        if (result?.pending) {
+            Module.states[envId].pendingResult = result.pending;
+            return -2;
+        }
+
+        if (!Array.isArray(result)) {
+            return result;
+        }
+
+        const returnDataKey = Module.states[envId].nextTXKey++;
+        Module.states[envId].transactionData[returnDataKey] = result;
+
+        return returnDataKey;
+    };
+
+    Module.luaError = function(L_ptr, s) {
+        Module.pushJsString(L_ptr, String(s));
+        return -1;
+    }
+});
+
+// the key is keyJson with LUA_JSON_MARSHALLING and keyValue otherwise
+EM_JS(int, getJSProperty, (int L_ptr, int envId, int jsRefId, const char* keyJson, const WebValue* keyValue), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    const keyData = keyJson
+        ? Module.luauToJsValue(envId, L_ptr, JSON.parse(UTF8ToString(keyJson)))
+        : Module.readWebValue(envId, L_ptr, keyValue);
+
+    const data = Module.jsValueEntry(envId, jsRefId);
+
+    if (!data) {
+        throw new GlueError("no data for index, ref " + jsRefId)
+    }
+    
+    if (!data[Module.JS_VALUE]) {
+        Module.fprintwarn("illegal state: js callback on non js data");  
+        return 0;
+    };
+
+    if (data[Module.JS_VALUE].released) {
+        Module.fprintwarn("illegal state: lua read on released js data"); 
+        return 0;
+    };
+
+    const rawVal = data[Module.JS_VALUE].value;
+    const value = rawVal instanceof Map ? rawVal.get(keyData) : rawVal[keyData];
+
+    Module.pushJsValue(envId, L_ptr, value, rawVal, keyData);
+
+    // 2 lets proxy_index memoize the value, see Module.isCacheableProperty
+    return Module.isCacheableProperty(rawVal, keyData, value) ? 2 : 1;
+});
+
+// key and value are keyJson and valueJson with LUA_JSON_MARSHALLING and the two WebValues at values otherwise
+EM_JS(int, setJSProperty, (int L_ptr, int envId, int jsRefId, const char* keyJson, const char* valueJson, const WebValue* values), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    const data = Module.jsValueEntry(envId, jsRefId);
+
+    if (!data) {
+        throw new GlueError("no data for newindex, ref " + jsRefId)
+    }
+
+    if (!data[Module.JS_VALUE]) {
+        Module.fprintwarn("illegal state: js callback on non js data");  
+        return 0;
+    };
+
+    if (data[Module.JS_VALUE].released) {
+        Module.fprintwarn("illegal state: lua write on released js data"); 
+        return 0;
+    };
+
+    if (typeof data[Module.JS_VALUE].value !== "object" || !(data[Module.JS_VALUE].value instanceof Map)) {
+        return Module.luaError(L_ptr, "attempt to modify a readonly table");
+    };
+
+    if (!data[Module.JS_VALUE].value.has(Module.JS_MUTABLE)) {
+        Module.fprintwarn("illegal state: lua write on non-mutable js data");
+        return Module.luaError(L_ptr, "attempt to modify a readonly table");
+    };
+
+    try {
+        const [keyData, valueData] = keyJson
+            ? [ JSON.parse(UTF8ToString(keyJson)), JSON.parse(UTF8ToString(valueJson)) ].map(v => Module.luauToJsValue(envId, L_ptr, v))
+            : Module.readWebValues(envId, L_ptr, values, 2);
+
+        data[Module.JS_VALUE].value.set(keyData, valueData);
+        return 0;
+    } catch (e) {
+        const errorStr = (e && e.toString) ? e.toString() : String(e);
+        return Module.luaError(L_ptr, errorStr);
+    }
+
+    return 0;
+});
+
+// cursor over a js value for proxy_iter. maps are streamed lazily with their keys as strings and everything else
+// yields its own enumerable keys, also as strings. with LUA_TYPED_ITER_KEYS, arrays and typed arrays are walked by
+// numeric index, map keys keep their js types, sets yield (value, true) and other iterables are streamed by index
+EM_JS(int, openJSIterator, (int L_ptr, int envId, int jsRefId), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    const data = Module.jsValueEntry(envId, jsRefId);
+
+    if (!data) {
+        throw new GlueError("no data for iterator, ref " + jsRefId)
+    }
+
+    if (!data[Module.JS_VALUE] || typeof data[Module.JS_VALUE].value !== "object" || data[Module.JS_VALUE].value === null) {
+        Module.luaError(L_ptr, "attempt to iterate a non-table value");
+        return 0;
+    }
+
+    const value = data[Module.JS_VALUE].value;
+    const typedKeys = !!Module.options.get("LUA_TYPED_ITER_KEYS");
+    const push = (L_ptr, key, item) => {
+        Module.pushJsValue(envId, L_ptr, key, null, "<key>");
+        Module.pushJsValue(envId, L_ptr, item, value, key);
+    };
+
+    let fill = null;
+    try {
+        if (typedKeys && (Array.isArray(value) || (ArrayBuffer.isView(value) && !(value instanceof DataView)))) {
+            let index = 0;
+            fill = (L_ptr, max) => {
+                let count = 0;
+                for (; count < max && index < value.length; count++, index++) {
+                    push(L_ptr, index, value[index]);
+                }
+                return count;
+            };
+        } else if (value instanceof Map || (typedKeys && (value instanceof Set || typeof value[Symbol.iterator] === "function"))) {
+            const isMap = value instanceof Map;
+            const isSet = value instanceof Set;
+            const iterator = isMap ? value.entries() : value[Symbol.iterator]();
+            let index = 0;
+            fill = (L_ptr, max) => {
+                let count = 0;
+                while (count < max) {
+                    const step = iterator.next();
+                    if (step.done) {
+                        break;
+                    }
+
+                    if (isMap) {
+                        const [key, item] = step.value;
+                        if (key === Module.LUA_VALUE || key === Module.JS_VALUE || key === Module.JS_MUTABLE) {
+                            continue;
+                        }
+                        push(L_ptr, typedKeys ? key : String(key), item);
+                    } else if (isSet) {
+                        push(L_ptr, step.value, true);
+                    } else {
+                        push(L_ptr, index++, step.value);
+                    }
+                    count++;
+                }
+                return count;
+            };
+        } else {
+            const keys = Object.keys(value);
+            let index = 0;
+            fill = (L_ptr, max) => {
+                let count = 0;
+                for (; count < max && index < keys.length; count++, index++) {
+                    push(L_ptr, keys[index], value[keys[index]]);
+                }
+                return count;
+            };
+        }
+    } catch (e) {
+        Module.luaError(L_ptr, "JSError: " + e.toString());
+        return 0;
+    }
+
+    // the cursor lives in the value cache so the iterator closure releases it like any other js ref
+    const ref = Module.getPersistentRef(envId, { fill }, null, "<iterator>");
+    if (!ref) {
+        Module.luaError(L_ptr, "JSError: could not create iterator");
+    }
+    return ref;
+});
+
+// pushes up to max key/value pairs from the cursor and returns how many, 0 once exhausted
+EM_JS(int, fillJSIterator, (int L_ptr, int envId, int cursorRef, int max), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    const cursor = Module.states[envId].jsValueCache.get(cursorRef)?.[Module.JS_VALUE]?.value;
+    if (!cursor || typeof cursor.fill !== "function") {
+        throw new GlueError("no data for iterator, ref " + cursorRef);
+    }
+
+    try {
+        return cursor.fill(L_ptr, max);
+    } catch (e) {
+        if (e instanceof RuntimeError || e instanceof GlueError) {
+            throw e;
+        }
+        return Module.luaError(L_ptr, "JSError: " + e.toString());
+    }
+});
+
+// clang-format on
+
+bool isReferenceType(int kind)
+{
     return kind == LUA_TVECTOR || kind == LUA_TTABLE || kind == LUA_TFUNCTION || kind == LUA_TUSERDATA || kind == LUA_TTHREAD || kind == LUA_TBUFFER;
 }
 
@@ -1186,7 +2297,7 @@ std::string serializeLuaValue(lua_State* L, int index, int* refOut)
                 detectedType = "jobject";
             }
 
-            std::string result = std::string("{\"type\":\"") + detectedType + std::string("\",\"value\":") + ud->ref + "}";
+            std::string result = std::string("{\"type\":\"") + detectedType + std::string("\",\"value\":") + std::to_string(ud->ref) + "}";
 
             return result;
         }
@@ -1200,11 +2311,9 @@ std::string serializeLuaValue(lua_State* L, int index, int* refOut)
         // note(xNasuni): it is possible for a "lua_tfunction" to have a js function closure but still be a "lua_tfunction"
         if (valueType == LUA_TFUNCTION)
         {
-            const void* ptr = lua_topointer(L, index);
-            auto jsfuncIt = jsfuncClosureMap.find(ptr);
-            if (jsfuncIt != jsfuncClosureMap.end())
+            if (jsref_ud* ud = getJSFunctionRef(L, index))
             {
-                return std::string("{\"type\":\"jfunction\",\"value\":") + jsfuncIt->second + "}";
+                return std::string("{\"type\":\"jfunction\",\"value\":") + std::to_string(ud->ref) + "}";
             }
         }
 
@@ -1225,101 +2334,323 @@ std::string serializeLuaValue(lua_State* L, int index, int* refOut)
     return "{\"type\":\"unknown\",\"value\":null}";
 }
 
-// clang-format off
-EM_JS(int, pushTransactionString, (int envId, const char* str), {
-    const transactionKey = Module.states[envId].nextTXKey++;
-    Module.states[envId].transactionData[transactionKey] = UTF8ToString(str);
-
-    return transactionKey;
-});
-// clang-format on
+static bool jsonMarshalling = false;
+static std::vector<WebValue> webValueScratch;
+static std::vector<char> webStringScratch;
 
-extern "C" int getLuaValue(lua_State* L, int index)
+extern "C" WebValue* webReserveValues(int count)
 {
-    int envId = getEnvId(L);
-    if (envId == -1)
-    {
-        fprinterr("illegal state: no environment id found for lua state");
-        return -1;
-    }
+    if (webValueScratch.size() < size_t(count))
+        webValueScratch.resize(count);
 
-    int ref = LUA_NOREF;
-    std::string value = serializeLuaValue(L, index, &ref);
+    return webValueScratch.data();
+}
 
-    lua_pop(L, 1);
+extern "C" char* webReserveStrings(int size)
+{
+    if (webStringScratch.size() < size_t(size))
+        webStringScratch.resize(size);
 
-    return pushTransactionString(envId, value.c_str());
+    return webStringScratch.data();
 }
 
-int proxy_index(lua_State* L)
+static uint8_t webValueReferenceTag(int kind)
 {
-    lua_getfield(L, LUA_REGISTRYINDEX, "LUAU_WEB_LOADING");
-    int isLoading = lua_toboolean(L, -1);
-    lua_pop(L, 1);
-
-    if (isLoading)
+    switch (kind)
     {
-        lua_pushnil(L);
-        return 1;
+    case LUA_TTABLE:
+        return WEBVALUE_LTABLE;
+    case LUA_TFUNCTION:
+        return WEBVALUE_LFUNCTION;
+    case LUA_TUSERDATA:
+        return WEBVALUE_LUSERDATA;
+    case LUA_TTHREAD:
+        return WEBVALUE_LTHREAD;
+    case LUA_TBUFFER:
+        return WEBVALUE_LBUFFER;
+    default:
+        return WEBVALUE_NIL;
     }
+}
 
-    jsref_ud* ud = (jsref_ud*)lua_touserdata(L, 1);
-    if (!ud || !ud->ref)
+// binary counterpart of serializeLuaValue; strings point into the lua heap so the value must stay on the stack until js has read it
+void encodeLuaValue(lua_State* L, int index, WebValue* out)
+{
+    int valueType = lua_type(L, index);
+
+    switch (valueType)
     {
-        fprinterr("illegal state: invalid userdata for proxy_index");
-        lua_pushnil(L);
-        return 1;
+    case LUA_TNIL:
+        out->tag = WEBVALUE_NIL;
+        return;
+    case LUA_TBOOLEAN:
+        out->tag = WEBVALUE_BOOLEAN;
+        out->boolean = lua_toboolean(L, index);
+        return;
+    case LUA_TNUMBER:
+        out->tag = WEBVALUE_NUMBER;
+        out->number = lua_tonumber(L, index);
+        return;
+    case LUA_TSTRING:
+    {
+        size_t len;
+        out->tag = WEBVALUE_STRING;
+        out->str = lua_tolstring(L, index, &len);
+        out->len = uint32_t(len);
+        return;
     }
-
-    const char* jsRefIdStr = ud->ref;
-    int keyType = lua_type(L, -1);
-
-    if (isValueType(keyType) || isReferenceType(keyType))
+    case LUA_TUSERDATA:
     {
-        int ref = LUA_REFNIL;
-        std::string luauKeyJson = serializeLuaValue(L, -1, &ref);
-
-        int envId = getEnvId(L);
-        if (envId == -1)
+        int tag = lua_userdatatag(L, index);
+        if (tag == UTAG_JSFUNC || tag == UTAG_JSOBJECT)
         {
-            fprinterr("illegal state: no environment id found for lua state");
-            lua_pop(L, 1);
-            return 0;
+            jsref_ud* ud = (jsref_ud*)lua_touserdata(L, index);
+            out->tag = tag == UTAG_JSFUNC ? WEBVALUE_JFUNCTION : WEBVALUE_JOBJECT;
+            out->ref = ud ? ud->ref : 0;
+            return;
         }
-
-        lua_pop(L, 1);
-
-        return getJSProperty((int)L, envId, jsRefIdStr, luauKeyJson.c_str());
+        [[fallthrough]];
     }
-    else
+    case LUA_TTABLE:
+    case LUA_TFUNCTION:
+    case LUA_TTHREAD:
+    case LUA_TBUFFER:
+    {
+        if (valueType == LUA_TFUNCTION)
+        {
+            if (jsref_ud* ud = getJSFunctionRef(L, index))
+            {
+                out->tag = WEBVALUE_JFUNCTION;
+                out->ref = ud->ref;
+                return;
+            }
+        }
+
+        out->tag = webValueReferenceTag(valueType);
+        out->ref = getPersistentRef(L, index);
+        return;
+    }
+    default:
+        fprintwarn("illegal serialization: unsupported value type '%s' [%d]", luauTypeName(valueType), valueType);
+        out->tag = WEBVALUE_NIL;
+        return;
+    }
+}
+
+// clang-format off
+EM_JS(int, pushTransactionString, (int envId, const char* str), {
+    const transactionKey = Module.states[envId].nextTXKey++;
+    Module.states[envId].transactionData[transactionKey] = UTF8ToString(str);
+
+    return transactionKey;
+});
+
+EM_JS(int, sendValueToJS, (int envId, const char* valueJson), {
+    const value = JSON.parse(UTF8ToString(valueJson));
+    const key = Module.states[envId].nextTXKey++;
+
+    Module.states[envId].transactionData[key] = value;
+
+    return key;
+});
+
+EM_JS(int, sendWebValueToJS, (int L_ptr, int envId, WebValue* valuePtr), {
+    const key = Module.states[envId].nextTXKey++;
+
+    Module.states[envId].transactionData[key] = Module.readWebValue(envId, L_ptr, valuePtr);
+
+    return key;
+});
+// clang-format on
+
+// pops the value at index and returns the transaction key js reads it from: a json string with
+// LUA_JSON_MARSHALLING, the js value otherwise, see Module.popLuaValue
+extern "C" int getLuaValue(lua_State* L, int index)
+{
+    int envId = getEnvId(L);
+    if (envId == -1)
+    {
+        fprinterr("illegal state: no environment id found for lua state");
+        return -1;
+    }
+
+    if (!jsonMarshalling)
+    {
+        WebValue* value = webReserveValues(1);
+        encodeLuaValue(L, index, value);
+
+        int transactionKey = sendWebValueToJS((int)L, envId, value);
+        lua_pop(L, 1);
+        return transactionKey;
+    }
+
+    int ref = LUA_NOREF;
+    std::string value = serializeLuaValue(L, index, &ref);
+
+    lua_pop(L, 1);
+
+    return pushTransactionString(envId, value.c_str());
+}
+
+// looks up the key on top of the stack, pushing the memoized value on a hit
+static bool getCachedProperty(lua_State* L, WebState* ws, int jsRefId)
+{
+    lua_getref(L, ws->propertyCacheRef);
+    lua_rawgeti(L, -1, jsRefId);
+
+    if (lua_istable(L, -1))
+    {
+        lua_pushvalue(L, -3);
+        lua_rawget(L, -2);
+
+        if (!lua_isnil(L, -1))
+        {
+            lua_replace(L, -3);
+            lua_pop(L, 1);
+            return true;
+        }
+
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 2);
+    return false;
+}
+
+// memoizes the value on top of the stack under the key right below it
+static void cacheProperty(lua_State* L, WebState* ws, int jsRefId)
+{
+    luaL_checkstack(L, 4, "property cache");
+
+    if (ws->propertyCacheRef == LUA_NOREF)
+    {
+        lua_newtable(L);
+        ws->propertyCacheRef = lua_ref(L, -1);
+        lua_pop(L, 1);
+    }
+
+    lua_getref(L, ws->propertyCacheRef);
+
+    // entries of collected objects can only be dropped here, the userdata destructor must not touch the stack
+    for (int id : ws->stalePropertyCaches)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, -2, id);
+    }
+    ws->stalePropertyCaches.clear();
+
+    lua_rawgeti(L, -1, jsRefId);
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, jsRefId);
+    }
+
+    lua_pushvalue(L, -4);
+    lua_pushvalue(L, -4);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+}
+
+int proxy_index(lua_State* L)
+{
+    if (getWebState(L)->loading)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    jsref_ud* ud = (jsref_ud*)lua_touserdata(L, 1);
+    if (!ud || ud->ref == 0)
+    {
+        fprinterr("illegal state: invalid userdata for proxy_index");
+        lua_pushnil(L);
+        return 1;
+    }
+
+    int jsRefId = ud->ref;
+    int keyType = lua_type(L, -1);
+
+    WebState* ws = getWebState(L);
+    if (ws->propertyCacheRef != LUA_NOREF && (keyType == LUA_TSTRING || keyType == LUA_TNUMBER) && getCachedProperty(L, ws, jsRefId))
+        return 1;
+
+    if (isValueType(keyType) || isReferenceType(keyType))
+    {
+        WebValue key;
+        std::string keyJson;
+        if (jsonMarshalling)
+        {
+            int ref = LUA_REFNIL;
+            keyJson = serializeLuaValue(L, -1, &ref);
+        }
+        else
+        {
+            encodeLuaValue(L, -1, &key);
+        }
+
+        int envId = getEnvId(L);
+        if (envId == -1)
+        {
+            fprinterr("illegal state: no environment id found for lua state");
+            lua_pop(L, 1);
+            return 0;
+        }
+
+        // the key stays below the result so a cacheable value can be stored under it
+        int result = getJSProperty((int)L, envId, jsRefId, jsonMarshalling ? keyJson.c_str() : nullptr, &key);
+        if (result == 2)
+        {
+            cacheProperty(L, ws, jsRefId);
+            result = 1;
+        }
+
+        return result;
+    }
+    else
     {
-        fprintwarn("illegal type: unsupported key type '%s' for object '%s'", luauTypeName(keyType), jsRefIdStr);
+        fprintwarn("illegal type: unsupported key type '%s' for object '%d'", luauTypeName(keyType), jsRefId);
         lua_pop(L, 1);
         return 0;
     }
 }
 
+extern "C" void invalidatePropertyCache(lua_State* L, int jsRefId);
+
 int proxy_newindex(lua_State* L)
 {
     jsref_ud* ud = (jsref_ud*)lua_touserdata(L, 1);
-    if (!ud || !ud->ref)
+    if (!ud || ud->ref == 0)
     {
         fprinterr("illegal state: invalid userdata for proxy_index");
         lua_pushnil(L);
         return 1;
     }
 
-    const char* jsRefIdStr = ud->ref;
+    int jsRefId = ud->ref;
 
     int keyType = lua_type(L, -2);
     int valueType = lua_type(L, -1);
 
     if ((isValueType(keyType) || isReferenceType(keyType)) && (isValueType(valueType) || isReferenceType(valueType)))
     {
-        int kref = LUA_REFNIL;
-        std::string luauKeyJson = serializeLuaValue(L, -2, &kref);
-        int vref = LUA_REFNIL;
-        std::string luauValueJson = serializeLuaValue(L, -1, &vref);
+        // both stay on the stack until js has read them
+        WebValue values[2];
+        std::string keyJson, valueJson;
+        if (jsonMarshalling)
+        {
+            int kref = LUA_REFNIL;
+            keyJson = serializeLuaValue(L, -2, &kref);
+            int vref = LUA_REFNIL;
+            valueJson = serializeLuaValue(L, -1, &vref);
+        }
+        else
+        {
+            encodeLuaValue(L, -2, &values[0]);
+            encodeLuaValue(L, -1, &values[1]);
+        }
 
         int envId = getEnvId(L);
         if (envId == -1)
@@ -1328,7 +2659,12 @@ int proxy_newindex(lua_State* L)
             return 0;
         }
 
-        int result = setJSProperty((int)L, envId, jsRefIdStr, luauKeyJson.c_str(), luauValueJson.c_str());
+        // writes from lua to an object marked immutable would otherwise leave stale memoized reads behind
+        if (getWebState(L)->propertyCacheRef != LUA_NOREF)
+            invalidatePropertyCache(L, jsRefId);
+
+        int result = jsonMarshalling ? setJSProperty((int)L, envId, jsRefId, keyJson.c_str(), valueJson.c_str(), nullptr)
+                                     : setJSProperty((int)L, envId, jsRefId, nullptr, nullptr, values);
         if (result == -1)
         {
             if (!lua_isstring(L, -1))
@@ -1348,11 +2684,11 @@ int proxy_newindex(lua_State* L)
     {
         if (!isValueType(keyType) && !isReferenceType(keyType))
         {
-            fprintwarn("illegal type: unsupported key type '%s' for object '%s'", luauTypeName(keyType), jsRefIdStr);
+            fprintwarn("illegal type: unsupported key type '%s' for object '%d'", luauTypeName(keyType), jsRefId);
         }
         if (!isValueType(valueType) && !isReferenceType(valueType))
         {
-            fprintwarn("illegal type: unsupported value type '%s' for object '%s'", luauTypeName(valueType), jsRefIdStr);
+            fprintwarn("illegal type: unsupported value type '%s' for object '%d'", luauTypeName(valueType), jsRefId);
         }
 
         lua_pop(L, 2);
@@ -1360,30 +2696,50 @@ int proxy_newindex(lua_State* L)
     }
 }
 
+// pairs fetched from js per crossing while iterating a js value
+const int kJSIteratorChunk = 256;
+
+// upvalues: 1 = cursor ref userdata, 2 = buffer of the current chunk, 3 = next pair in the buffer, 4 = pairs in the buffer
 int proxy_iter_next(lua_State* L)
 {
-    int envId = getEnvId(L);
-    if (envId == -1)
+    int pos = lua_tointeger(L, lua_upvalueindex(3));
+    int count = lua_tointeger(L, lua_upvalueindex(4));
+
+    if (pos > count)
     {
-        fprinterr("illegal state: no environment id found for lua state");
-        return 0;
-    }
+        int envId = getEnvId(L);
+        if (envId == -1)
+        {
+            fprinterr("illegal state: no environment id found for lua state");
+            return 0;
+        }
 
-    const char* jsRefIdStr = lua_tostring(L, lua_upvalueindex(1));
-    const char* keysRefIdStr = lua_tostring(L, lua_upvalueindex(2));
-    int index = lua_tointeger(L, lua_upvalueindex(3));
+        jsref_ud* cursor = (jsref_ud*)lua_touserdata(L, lua_upvalueindex(1));
+        luaL_checkstack(L, kJSIteratorChunk * 2, "iterating js value");
 
-    int found = getJSIteratorNext((int)L, envId, jsRefIdStr, keysRefIdStr, index);
+        count = fillJSIterator((int)L, envId, cursor->ref, kJSIteratorChunk);
+        if (count < 0)
+            lua_error(L);
 
-    if (found)
-    {
-        lua_pushinteger(L, index + 1);
-        lua_replace(L, lua_upvalueindex(3));
+        // pairs were pushed in order, move them into the buffer from the top down
+        for (int i = count * 2; i >= 1; i--)
+            lua_rawseti(L, lua_upvalueindex(2), i);
 
-        return 2;
+        pos = 1;
+        lua_pushinteger(L, count);
+        lua_replace(L, lua_upvalueindex(4));
+
+        if (count == 0)
+            return 0;
     }
 
-    return 0;
+    lua_rawgeti(L, lua_upvalueindex(2), pos * 2 - 1);
+    lua_rawgeti(L, lua_upvalueindex(2), pos * 2);
+
+    lua_pushinteger(L, pos + 1);
+    lua_replace(L, lua_upvalueindex(3));
+
+    return 2;
 }
 
 int proxy_iter(lua_State* L)
@@ -1397,14 +2753,14 @@ int proxy_iter(lua_State* L)
     }
 
     jsref_ud* ud = (jsref_ud*)lua_touserdata(L, 1);
-    if (!ud || !ud->ref)
+    if (!ud || ud->ref == 0)
     {
         lua_pushnil(L);
         return 1;
     }
 
-    char* keysRefRaw = prepareJSKeyList((int)L, envId, ud->ref);
-    if (!keysRefRaw)
+    int cursorRef = openJSIterator((int)L, envId, ud->ref);
+    if (!cursorRef)
     {
         if (!lua_isstring(L, -1))
         {
@@ -1416,25 +2772,22 @@ int proxy_iter(lua_State* L)
         return 0;
     }
 
-    lua_pushstring(L, ud->ref);
-    lua_pushstring(L, keysRefRaw);
+    pushJSRefValue(L, WEBVALUE_JOBJECT, cursorRef, "<iterator>");
+    lua_createtable(L, kJSIteratorChunk * 2, 0);
+    lua_pushinteger(L, 1);
     lua_pushinteger(L, 0);
 
-    releaseJSKeyList(envId, keysRefRaw);
-    free(keysRefRaw);
-
-    lua_pushcclosure(L, proxy_iter_next, "proxy_iter_next", 3);
+    lua_pushcclosure(L, proxy_iter_next, "proxy_iter_next", 4);
 
     return 1;
 }
 
 // clang-format off
-EM_ASYNC_JS(int, callJSFunction, (int L_ptr, int envId, const char* jsRefIdJson, const char* argsJson), {
+EM_JS(int, callJSFunction, (int L_ptr, int envId, int jsRefId, const char* argsJson), {
     if (!Module.states[envId]) {
         throw new RuntimeError("no state for env id " + envId);
     }
 
-    const pathStr = UTF8ToString(jsRefIdJson);
     const argsStr = UTF8ToString(argsJson);
 
     const rawArgs = JSON.parse(argsStr);
@@ -1445,67 +2798,39 @@ EM_ASYNC_JS(int, callJSFunction, (int L_ptr, int envId, const char* jsRefIdJson,
         return Module.tryConvertLuaTableToArray(envId, L_ptr, jsValue);
     });
 
-    const key = JSON.parse(pathStr);
-    var trimmed = [];
-
-    if (Module.states[envId].jsValueCache.has(key)) {
-        const data = Module.states[envId].jsValueCache.get(key)[Module.JS_VALUE];
-        const returnData = [null];
+    return Module.stashJSResult(envId, Module.applyJSFunction(envId, L_ptr, jsRefId, args));
+});
 
-        if (data && data.value) {
-            try {
-                const func = data.value;
-                const ctx = data.parent?.[Module.JS_VALUE]?.value ?? null;
-        
-                try {
-                    returnData[0] = func.apply(ctx, args);
-                } catch (e) {
-                    // todo(xNasuni): find better method of detecting constructors, this works though
-                    if (e.toString().toLowerCase().includes("constructor") &&
-                        e.toString().toLowerCase().includes("new")) {
-                        returnData[0] = Reflect.construct(func, args);
-                    } else {
-                        throw e;
-                    }
-                }
+EM_JS(int, callJSFunctionBinary, (int L_ptr, int envId, int jsRefId, WebValue* argsPtr, int argc), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
 
-                if (returnData[0] != null && typeof returnData[0] === 'object' && typeof returnData[0].then === 'function') {
-                    try {
-                        returnData[0] = await returnData[0];
-                    } catch (e) {
-                        if (e instanceof Module.FatalJSError) {
-                            throw e;
-                        }
-                        const errorStr = (e && e.toString) ? e.toString() : String(e);
-                        return Module.luaError(L_ptr, errorStr);
-                    }
-                }
-            } catch (e) {
-                if (e instanceof Module.FatalJSError) {
-                    throw e;
-                } else {
-                    const errorStr = (e && e.toString) ? e.toString() : String(e);
-                    return Module.luaError(L_ptr, errorStr);
-                }
-            }
+    const args = Module.readWebValues(envId, L_ptr, argsPtr, argc).map(jsValue => {
+        return Module.tryConvertLuaTableToArray(envId, L_ptr, jsValue);
+    });
 
-            // possibly re-enable in the future for long term applications
-            // args.forEach(arg => arg?.[Module.LUA_VALUE]?.release?.());
+    return Module.stashJSResult(envId, Module.applyJSFunction(envId, L_ptr, jsRefId, args));
+});
 
-            trimmed = Array.isArray(returnData[0]) ? [...returnData[0]] : [returnData[0]];
-        } else {
-            Module.fprintwarn("illegal state: no js val found for path", pathStr);
-            return Module.luaError(L_ptr, 'illegal state');
-        }
-    } else {
-        Module.fprintwarn("illegal state: no js function found for path", pathStr);
-        return Module.luaError(L_ptr, 'illegal state');
+// a cooperative state can only wait by yielding its call thread, luaResumeCall is not a promising export so the
+// wasm stack cannot be suspended under it with either jspi or asyncify
+EM_JS(int, canAwaitJSCall, (int envId, int cooperative), {
+    if (!cooperative) {
+        return 1;
     }
 
-    const returnDataKey = Module.states[envId].nextTXKey++;
-    Module.states[envId].transactionData[returnDataKey] = trimmed;
+    Promise.resolve(Module.states[envId].pendingResult).catch(() => {});
+    delete Module.states[envId].pendingResult;
+    return 0;
+});
+
+// only reached when the js function returned a thenable, this is the one place a lua->js call suspends
+EM_ASYNC_JS(int, awaitJSCall, (int L_ptr, int envId), {
+    const pending = Module.states[envId].pendingResult;
+    delete Module.states[envId].pendingResult;
 
-    return returnDataKey;
+    return Module.stashJSResult(envId, await Module.awaitJSResult(L_ptr, pending));
 });
 
 EM_JS(int, retrieveRetc, (int returnDataKey), {
@@ -1527,26 +2852,43 @@ EM_JS(int, pushRetData, (int L_ptr, int envId, int returnDataKey), {
     }
 
     returnData.forEach((data) => {
-        const [type, value] = Module.jsToLuauValue(envId, null, data);
-        Module.ccall('pushValueToLuaWrapper', 'void', [ 'number', 'string', 'string', 'string' ], [ L_ptr, type, value, `${value}` ]);
+        Module.pushJsValue(envId, L_ptr, data, null, "<return>");
     });
 
     return returnData.length;
 });
 
+EM_JS(int, writeRetData, (int L_ptr, int envId, int returnDataKey), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    const returnData = Module.states[envId].transactionData[returnDataKey];
+    delete Module.states[envId].transactionData[returnDataKey];
+
+    if (!returnData || !Array.isArray(returnData) || returnData.length <= 0) {
+        return 0;
+    }
+
+    Module.writeWebValues(envId, returnData, "<return>");
+    return returnData.length;
+});
+
 // clang-format on
 
+static void pushWebValues(lua_State* L, int count, const char* key);
+
 int proxy_call(lua_State* L)
 {
     jsref_ud* ud = (jsref_ud*)lua_touserdata(L, 1);
-    if (!ud || !ud->ref)
+    if (!ud || ud->ref == 0)
     {
         fprinterr("illegal state: invalid userdata for proxy_index");
         lua_pushnil(L);
         return 1;
     }
 
-    const char* jsRefIdStr = ud->ref;
+    int jsRefId = ud->ref;
 
     int envId = getEnvId(L);
 
@@ -1557,20 +2899,57 @@ int proxy_call(lua_State* L)
     }
 
     int argc = lua_gettop(L);
+    int returnDataKey = -1;
+
+    flushJSReleases();
 
-    std::string argsJson = "[";
-    for (int i = 1; i <= argc; i++)
+    if (jsonMarshalling)
     {
-        int ref = LUA_REFNIL;
-        argsJson += serializeLuaValue(L, i, &ref);
-        if (i < argc)
+        std::string argsJson = "[";
+        for (int i = 1; i <= argc; i++)
         {
-            argsJson += ",";
+            int ref = LUA_REFNIL;
+            argsJson += serializeLuaValue(L, i, &ref);
+            if (i < argc)
+            {
+                argsJson += ",";
+            }
         }
+        argsJson += "]";
+
+        returnDataKey = callJSFunction((int)L, envId, jsRefId, argsJson.c_str());
+    }
+    else
+    {
+        // first argument is the jsref userdata itself
+        int nargs = argc > 1 ? argc - 1 : 0;
+        WebValue* args = webReserveValues(nargs);
+        for (int i = 0; i < nargs; i++)
+            encodeLuaValue(L, i + 2, &args[i]);
+
+        returnDataKey = callJSFunctionBinary((int)L, envId, jsRefId, args, nargs);
     }
-    argsJson += "]";
 
-    int returnDataKey = callJSFunction((int)L, envId, jsRefIdStr, argsJson.c_str());
+    if (returnDataKey == -2)
+    {
+        WebState* ws = getWebState(L);
+
+        // call threads hand the promise to Module.runLuaCallThread, which resumes them once it settles
+        if (ws->callThreads.count(L) && lua_isyieldable(L))
+            return lua_yield(L, 0);
+
+        if (!canAwaitJSCall(envId, ws->cooperative))
+            luaL_error(L, "attempt to await a js promise across a metamethod/C-call boundary or from a coroutine");
+
+        // time spent suspended on the promise is not lua time, the rest of the call starts a new slice
+        ws->executionTime += emscripten_get_now() - ws->sliceStart;
+        returnDataKey = awaitJSCall((int)L, envId);
+        ws->sliceStart = emscripten_get_now();
+        ws->interruptCount = 0;
+
+        // other sandboxes may have run while this one was suspended
+        templateAllocator.activeMemcat = ws->memcat;
+    }
 
     if (returnDataKey == -1)
     {
@@ -1584,7 +2963,12 @@ int proxy_call(lua_State* L)
         return 0;
     }
 
-    return pushRetData((int)L, envId, returnDataKey);
+    if (jsonMarshalling)
+        return pushRetData((int)L, envId, returnDataKey);
+
+    int nresults = writeRetData((int)L, envId, returnDataKey);
+    pushWebValues(L, nresults, "<return>");
+    return nresults;
 }
 
 int jsfunc_wrapper(lua_State* L)
@@ -1594,6 +2978,31 @@ int jsfunc_wrapper(lua_State* L)
     return proxy_call(L);
 }
 
+// closure debug names have to outlive the closure, so they are interned instead of duplicated per push
+static const char* internDebugName(const char* name)
+{
+    static std::unordered_set<std::string> debugNames;
+    return debugNames.insert(name).first->c_str();
+}
+
+static void pushJSRefValue(lua_State* L, int tag, int id, const char* key)
+{
+    if (id == 0)
+    {
+        fprintwarn("illegal push: js %s value '%s' is blocked", tag == WEBVALUE_JFUNCTION ? "function" : "object", key ? key : "unknown");
+        lua_pushnil(L);
+        return;
+    }
+
+    jsref_ud* ud = (jsref_ud*)lua_newuserdatataggedwithmetatable(L, sizeof(jsref_ud), tag == WEBVALUE_JFUNCTION ? UTAG_JSFUNC : UTAG_JSOBJECT);
+    ud->ref = id;
+    ud->ws = getWebState(L);
+    ud->ws->jsrefCounts[id]++;
+
+    if (tag == WEBVALUE_JFUNCTION)
+        lua_pushcclosurek(L, jsfunc_wrapper, key ? internDebugName(key) : "", 1, NULL);
+}
+
 void pushValueToLua(lua_State* L, const char* type, const char* value, const char* key = nullptr)
 {
     if (strcmp(type, "number") == 0)
@@ -1621,44 +3030,388 @@ void pushValueToLua(lua_State* L, const char* type, const char* value, const cha
     }
     else if (strcmp(type, "jobject") == 0 || strcmp(type, "jsymbol") == 0)
     {
-        int ref = atoi(value);
-        if (ref == 0)
+        pushJSRefValue(L, WEBVALUE_JOBJECT, atoi(value), key);
+    }
+    else if (strcmp(type, "jfunction") == 0)
+    {
+        pushJSRefValue(L, WEBVALUE_JFUNCTION, atoi(value), key);
+    }
+    else
+    {
+        fprintwarn(
+            "illegal push: unsupported type '%s' for key '%s' with value '%s'",
+            type ? type : "unknown",
+            key ? key : "unknown",
+            value ? value : "unknown"
+        );
+        lua_pushnil(L);
+    }
+}
+
+void pushWebValue(lua_State* L, const WebValue& value, const char* key)
+{
+    switch (value.tag)
+    {
+    case WEBVALUE_NIL:
+        lua_pushnil(L);
+        break;
+    case WEBVALUE_BOOLEAN:
+        lua_pushboolean(L, value.boolean);
+        break;
+    case WEBVALUE_NUMBER:
+        lua_pushnumber(L, value.number);
+        break;
+    case WEBVALUE_STRING:
+        lua_pushlstring(L, value.str, value.len);
+        break;
+    case WEBVALUE_LTABLE:
+    case WEBVALUE_LFUNCTION:
+    case WEBVALUE_LUSERDATA:
+    case WEBVALUE_LTHREAD:
+    case WEBVALUE_LBUFFER:
+        lua_getref(L, value.ref);
+        break;
+    case WEBVALUE_JOBJECT:
+    case WEBVALUE_JFUNCTION:
+    case WEBVALUE_JSYMBOL:
+        pushJSRefValue(L, value.tag, value.ref, key);
+        break;
+    default:
+        fprintwarn("illegal push: unsupported tag '%d' for key '%s'", value.tag, key ? key : "unknown");
+        lua_pushnil(L);
+        break;
+    }
+}
+
+// pushes values written to the scratch buffer by Module.writeWebValues
+static void pushWebValues(lua_State* L, int count, const char* key)
+{
+    luaL_checkstack(L, count, "too many values from js");
+
+    for (int i = 0; i < count; i++)
+        pushWebValue(L, webValueScratch[i], key);
+}
+
+struct TableSnapshot
+{
+    std::vector<WebValue> values;
+    std::unordered_map<const void*, int32_t> visited; // table -> position of its header
+    std::vector<const void*> visitOrder;
+    int maxDepth = 0;
+    bool arraysOnly = false; // tables that are not a non-empty sequence stay references
+};
+
+static TableSnapshot tableSnapshot;
+
+static void snapshotValue(lua_State* L, int index, TableSnapshot& snap, int depth);
+
+static void snapshotTable(lua_State* L, int index, TableSnapshot& snap, int depth)
+{
+    const void* ptr = lua_topointer(L, index);
+
+    auto it = snap.visited.find(ptr);
+    if (it != snap.visited.end())
+    {
+        WebValue& cycle = snap.values.emplace_back();
+        cycle.tag = WEBVALUE_SNAPSHOT_CYCLE;
+        cycle.ref = it->second;
+        return;
+    }
+
+    if (depth >= snap.maxDepth)
+    {
+        encodeLuaValue(L, index, &snap.values.emplace_back());
+        return;
+    }
+
+    luaL_checkstack(L, 2, "table snapshot is too deep");
+
+    int32_t header = int32_t(snap.values.size());
+    snap.visited[ptr] = header;
+    snap.visitOrder.push_back(ptr);
+    snap.values.emplace_back().tag = WEBVALUE_SNAPSHOT_TABLE;
+
+    // lua_rawiter walks the array part first, items stay in the array section for as long as their keys are consecutive
+    uint32_t arrayCount = 0;
+    int32_t pairCount = 0;
+    bool sequence = true;
+
+    for (int iter = 0; (iter = lua_rawiter(L, index, iter)) >= 0;)
+    {
+        if (sequence && lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) == double(arrayCount + 1))
         {
-            fprintwarn("illegal push: js %s value '%s' is blocked", type, key ? key : "unknown");
-            lua_pushnil(L);
-            return;
+            snapshotValue(L, -1, snap, depth + 1);
+            arrayCount++;
+        }
+        else
+        {
+            sequence = false;
+            snapshotValue(L, -2, snap, depth + 1);
+            snapshotValue(L, -1, snap, depth + 1);
+            pairCount++;
         }
 
-        jsref_ud* ud = (jsref_ud*)lua_newuserdatataggedwithmetatable(L, sizeof(jsref_ud), UTAG_JSOBJECT);
-        ud->ref = strdup(value);
+        lua_pop(L, 2);
     }
-    else if (strcmp(type, "jfunction") == 0)
+
+    if (snap.arraysOnly && (pairCount > 0 || arrayCount == 0))
     {
-        int ref = atoi(value);
-        if (ref == 0)
+        while (!snap.visitOrder.empty() && snap.visited[snap.visitOrder.back()] >= header)
         {
-            fprintwarn("illegal push: js function value '%s' is blocked", key ? key : "unknown");
-            lua_pushnil(L);
-            return;
+            snap.visited.erase(snap.visitOrder.back());
+            snap.visitOrder.pop_back();
         }
 
-        jsref_ud* ud = (jsref_ud*)lua_newuserdatataggedwithmetatable(L, sizeof(jsref_ud), UTAG_JSFUNC);
-        ud->ref = strdup(value);
-        lua_pushcclosurek(L, jsfunc_wrapper, key ? strdup(key) : "", 1, NULL);
+        snap.values.resize(header);
+        encodeLuaValue(L, index, &snap.values.emplace_back());
+        return;
+    }
+
+    snap.values[header].len = arrayCount;
+    snap.values[header].ref = pairCount;
+}
+
+static void snapshotValue(lua_State* L, int index, TableSnapshot& snap, int depth)
+{
+    index = lua_absindex(L, index);
+
+    if (lua_type(L, index) == LUA_TTABLE)
+        snapshotTable(L, index, snap, depth);
+    else
+        encodeLuaValue(L, index, &snap.values.emplace_back());
+}
+
+// encodes a whole table in one pass for Module.readTableSnapshot, tables deeper than maxDepth are left as references
+extern "C" WebValue* luaTableSnapshot(lua_State* L, int ref, int maxDepth, int arraysOnly)
+{
+    TableSnapshot& snap = tableSnapshot;
+    snap.values.clear();
+    snap.visited.clear();
+    snap.visitOrder.clear();
+    snap.maxDepth = maxDepth;
+    snap.arraysOnly = arraysOnly != 0;
+
+    lua_getref(L, ref);
+    snapshotValue(L, -1, snap, 0);
+    lua_pop(L, 1);
+
+    return snap.values.data();
+}
+
+// builds the value encoded at values[pos] on the stack and returns the position after it
+static size_t pushSnapshotValue(lua_State* L, const WebValue* values, size_t pos, int tablesIndex)
+{
+    const WebValue& value = values[pos];
+
+    if (value.tag == WEBVALUE_SNAPSHOT_CYCLE)
+    {
+        lua_rawgeti(L, tablesIndex, value.ref + 1);
+        return pos + 1;
+    }
+
+    if (value.tag != WEBVALUE_SNAPSHOT_TABLE)
+    {
+        pushWebValue(L, value, "<table>");
+        return pos + 1;
+    }
+
+    luaL_checkstack(L, 3, "table snapshot is too deep");
+
+    lua_createtable(L, int(value.len), value.ref);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, tablesIndex, int(pos) + 1);
+    pos++;
+
+    for (uint32_t i = 1; i <= value.len; i++)
+    {
+        pos = pushSnapshotValue(L, values, pos, tablesIndex);
+        lua_rawseti(L, -2, int(i));
+    }
+
+    for (int32_t i = 0; i < value.ref; i++)
+    {
+        pos = pushSnapshotValue(L, values, pos, tablesIndex);
+        pos = pushSnapshotValue(L, values, pos, tablesIndex);
+
+        if (lua_isnil(L, -2))
+        {
+            fprintwarn("illegal j2l conversion: table key is nil, skipped");
+            lua_pop(L, 2);
+            continue;
+        }
+
+        lua_rawset(L, -3);
+    }
+
+    return pos;
+}
+
+// builds a table from a snapshot written by Module.writeTableSnapshot and returns a registry ref to it
+extern "C" int luaTableFromSnapshot(lua_State* L, const WebValue* values)
+{
+    // position -> table, for cycles
+    lua_newtable(L);
+    int tablesIndex = lua_gettop(L);
+
+    pushSnapshotValue(L, values, 0, tablesIndex);
+
+    int ref = lua_ref(L, -1);
+    lua_pop(L, 2);
+    return ref;
+}
+
+// property and global names registered once by js, so hot paths pass a key id instead of a string
+static std::vector<std::string> keyNames(1); // id 0 is never handed out
+static std::unordered_map<std::string, int> keyIds;
+
+extern "C" int registerKey(const char* name, int len)
+{
+    std::string key(name, len);
+
+    auto it = keyIds.find(key);
+    if (it != keyIds.end())
+        return it->second;
+
+    int id = int(keyNames.size());
+    keyNames.push_back(key);
+    keyIds[key] = id;
+    return id;
+}
+
+// pushes the interned string of a key id, each state pins it in its registry the first time the id is used
+static bool pushKey(lua_State* L, int keyId)
+{
+    if (keyId <= 0 || size_t(keyId) >= keyNames.size())
+    {
+        fprintwarn("illegal key: unknown key id %d", keyId);
+        return false;
+    }
+
+    WebState* ws = getWebState(L);
+    if (size_t(keyId) >= ws->keyRefs.size())
+        ws->keyRefs.resize(keyNames.size(), LUA_NOREF);
+
+    int& ref = ws->keyRefs[keyId];
+    if (ref == LUA_NOREF)
+    {
+        lua_pushlstring(L, keyNames[keyId].data(), keyNames[keyId].size());
+        ref = lua_ref(L, -1);
+    }
+    else
+    {
+        lua_getref(L, ref);
+    }
+
+    return true;
+}
+
+// the value is the first entry of the value scratch, written by Module.writeWebValues
+extern "C" void setGlobalById(lua_State* L, int keyId)
+{
+    if (!pushKey(L, keyId))
+        return;
+
+    pushWebValues(L, 1, keyNames[keyId].c_str());
+    lua_settable(L, LUA_GLOBALSINDEX);
+}
+
+// environment tables shared by forked sandboxes, cache id -> template registry ref, see installEnvironment
+static std::unordered_map<int, int> sharedEnvironments;
+static lua_State* getTemplateState();
+
+// builds the table for installEnvironment on B from the value scratch, it falls back to the globals of B; without
+// keyIds the first count scratch entries are the keys and the values follow them
+static void pushEnvironmentTable(lua_State* B, const int32_t* keyIds, int count, bool freeze)
+{
+    lua_createtable(B, 0, count);
+
+    const WebValue* values = keyIds ? webValueScratch.data() : webValueScratch.data() + count;
+    std::string name;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (keyIds)
+        {
+            if (!pushKey(B, keyIds[i]))
+                continue;
+
+            name = keyNames[keyIds[i]];
+        }
+        else
+        {
+            const WebValue& key = webValueScratch[i];
+            pushWebValue(B, key, "<env>");
+            name = key.tag == WEBVALUE_STRING ? std::string(key.str, key.len) : "<env>";
+        }
+
+        pushWebValue(B, values[i], name.c_str());
+        lua_rawset(B, -3);
+    }
+
+    // sandboxed globals already fall back to the real ones, so reuse that metatable when there is one
+    if (!lua_getmetatable(B, LUA_GLOBALSINDEX))
+    {
+        lua_createtable(B, 0, 1);
+        lua_pushvalue(B, LUA_GLOBALSINDEX);
+        lua_setfield(B, -2, "__index");
+        lua_setreadonly(B, -1, true);
+    }
+    lua_setmetatable(B, -2);
+
+    if (freeze)
+        lua_setreadonly(B, -1, true);
+}
+
+// installs count globals (key ids at keyIds or keys in the value scratch, values in the value scratch) behind the
+// sandbox globals in one call; cacheId != 0 shares one frozen table between forked sandboxes, count is 0 when js
+// knows the table is cached
+extern "C" void installEnvironment(lua_State* L, const int32_t* keyIds, int count, int freeze, int cacheId)
+{
+    WebState* ws = getWebState(L);
+
+    // standalone states have their own heap, so they always get their own table
+    bool share = cacheId != 0 && ws->threadRef != LUA_NOREF;
+
+    auto it = sharedEnvironments.find(cacheId);
+    if (share && it != sharedEnvironments.end())
+    {
+        lua_getref(L, it->second);
+    }
+    else if (share)
+    {
+        // built on the template so the js values belong to it rather than to the first sandbox
+        lua_State* T = getTemplateState();
+        pushEnvironmentTable(T, keyIds, count, true);
+
+        int ref = lua_ref(T, -1);
+        lua_pop(T, 1);
+
+        sharedEnvironments[cacheId] = ref;
+        lua_getref(L, ref);
+    }
+    else
+    {
+        pushEnvironmentTable(L, keyIds, count, freeze != 0);
+    }
+
+    lua_createtable(L, 0, 1);
+    lua_pushvalue(L, -2);
+    lua_setfield(L, -2, "__index");
+    lua_setreadonly(L, -1, true);
+    lua_setmetatable(L, LUA_GLOBALSINDEX);
+
+    lua_pop(L, 1);
+}
+
+// unanchors a shared environment table, it is collected with its js values once no sandbox uses it
+extern "C" void releaseEnvironment(int cacheId)
+{
+    auto it = sharedEnvironments.find(cacheId);
+    if (it == sharedEnvironments.end())
+        return;
 
-        const void* closurePtr = lua_topointer(L, -1);
-        jsfuncClosureMap[closurePtr] = std::string(value);
-    }
-    else
-    {
-        fprintwarn(
-            "illegal push: unsupported type '%s' for key '%s' with value '%s'",
-            type ? type : "unknown",
-            key ? key : "unknown",
-            value ? value : "unknown"
-        );
-        lua_pushnil(L);
-    }
+    lua_unref(getTemplateState(), it->second);
+    sharedEnvironments.erase(it);
 }
 
 extern "C" void pushGlobalToLua(lua_State* L, const char* key, const char* type, const char* value)
@@ -1673,11 +3426,50 @@ extern "C" void pushGlobalToLua(lua_State* L, const char* key, const char* type,
     lua_setglobal(L, key);
 }
 
+// key and value are the first two entries of the value scratch, written by Module.writeWebValues
+extern "C" void setGlobalValue(lua_State* L)
+{
+    pushWebValues(L, 2, "<global>");
+    lua_settable(L, LUA_GLOBALSINDEX);
+}
+
 extern "C" void pushValueToLuaWrapper(lua_State* L, const char* type, const char* value, const char* key)
 {
     pushValueToLua(L, type, value, key);
 }
 
+// typed push entry points, called directly from js as Module._pushX without ccall string marshalling
+extern "C" void pushNil(lua_State* L)
+{
+    lua_pushnil(L);
+}
+
+extern "C" void pushNumber(lua_State* L, double n)
+{
+    lua_pushnumber(L, n);
+}
+
+extern "C" void pushBool(lua_State* L, int b)
+{
+    lua_pushboolean(L, b);
+}
+
+extern "C" void pushString(lua_State* L, const char* str, int len)
+{
+    lua_pushlstring(L, str, len);
+}
+
+extern "C" void pushRef(lua_State* L, int ref)
+{
+    lua_getref(L, ref);
+}
+
+// tag is one of WEBVALUE_JOBJECT, WEBVALUE_JFUNCTION or WEBVALUE_JSYMBOL, name is only used as the debug name of functions
+extern "C" void pushJsRef(lua_State* L, int id, int tag, const char* name)
+{
+    pushJSRefValue(L, tag, id, name);
+}
+
 // clang-format off
 EM_JS(int, pushArgs, (int L_int, int envId, int argIdx), {
     if (!Module.states[envId]) {
@@ -1689,8 +3481,7 @@ EM_JS(int, pushArgs, (int L_int, int envId, int argIdx), {
     delete Module.states[envId].transactionData[argIdx];
 
     argData.forEach((data) => {
-        const [type, value] = Module.jsToLuauValue(envId, null, data);
-        Module.ccall("pushValueToLuaWrapper", 'void', [ 'number', 'string', 'string', 'string' ], [ L_int, type, value, '<callarg>' ]);
+        Module.pushJsValue(envId, L_int, data, null, "<callarg>");
     });
     
     return length;
@@ -1704,6 +3495,42 @@ EM_JS(void, setMultretData, (int L_int, int envId, const char* multretJson, int
     const multretData = JSON.parse(UTF8ToString(multretJson));
     Module.states[envId].transactionData[argIdx] = multretData;
 })
+
+EM_JS(int, writeArgs, (int L_int, int envId, int argIdx), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    const argData = Module.states[envId].transactionData[argIdx];
+    delete Module.states[envId].transactionData[argIdx];
+
+    Module.writeWebValues(envId, argData, "<callarg>");
+    return argData.length;
+});
+
+EM_JS(void, setMultretBinary, (int L_int, int envId, WebValue* valuesPtr, int count, int argIdx), {
+    if (!Module.states[envId]) {
+        throw new RuntimeError("no state for env id " + envId);
+    }
+
+    Module.states[envId].transactionData[argIdx] = Module.readWebValues(envId, L_int, valuesPtr, count);
+});
+
+EM_JS(int, getIntOption, (const char* name, int fallback), {
+    const value = Module.options.get(UTF8ToString(name));
+    return value === undefined ? fallback : Number(value) | 0;
+});
+
+EM_JS(void, ensureInteropState, (int envId), {
+    if (!Module.states[envId]) {
+        Module.createInteropState(envId);
+    }
+});
+
+EM_JS(int, useJsonMarshalling, (), {
+    Module.jsonMarshalling = !!Module.options.get("LUA_JSON_MARSHALLING");
+    return Module.jsonMarshalling ? 1 : 0;
+});
 // clang-format on
 
 static std::string escapeJsonString(const char* str)
@@ -1747,6 +3574,55 @@ static std::string escapeJsonString(const char* str)
     return escaped;
 }
 
+static void setMultretResults(lua_State* L, int envId, int base, int argIdx)
+{
+    int nresults = lua_gettop(L) - base;
+
+    if (jsonMarshalling)
+    {
+        std::string retJson = "[";
+
+        for (int i = 1; i <= nresults; i++)
+        {
+            int ref = LUA_NOREF;
+            retJson += serializeLuaValue(L, base + i, &ref);
+
+            if (i < nresults)
+            {
+                retJson += ",";
+            }
+        }
+
+        retJson += "]";
+        setMultretData((int)L, envId, retJson.c_str(), argIdx);
+    }
+    else
+    {
+        WebValue* results = webReserveValues(nresults);
+        for (int i = 0; i < nresults; i++)
+            encodeLuaValue(L, base + i + 1, &results[i]);
+
+        setMultretBinary((int)L, envId, results, nresults, argIdx);
+    }
+}
+
+static void setMultretError(lua_State* L, int envId, const char* errMsg, int argIdx)
+{
+    if (jsonMarshalling)
+    {
+        std::string errorJson = "[{\"error\":\"" + escapeJsonString(errMsg) + "\"}]";
+        setMultretData((int)L, envId, errorJson.c_str(), argIdx);
+    }
+    else
+    {
+        WebValue* error = webReserveValues(1);
+        error->tag = WEBVALUE_ERROR;
+        error->str = errMsg;
+        error->len = uint32_t(strlen(errMsg));
+        setMultretBinary((int)L, envId, error, 1, argIdx);
+    }
+}
+
 extern "C" int luaPcall(lua_State* L, int ref, int argIdx)
 {
     int top = lua_gettop(L);
@@ -1763,6 +3639,8 @@ extern "C" int luaPcall(lua_State* L, int ref, int argIdx)
         return LUA_ERRRUN;
     }
 
+    ScopedLuaSlice slice(getWebState(L));
+
     try
     {
         if (ref != LUA_NOREF)
@@ -1770,39 +3648,31 @@ extern "C" int luaPcall(lua_State* L, int ref, int argIdx)
             lua_getref(L, ref);
         }
 
-        int nargs = pushArgs((int)L, envId, argIdx);
+        int nargs = 0;
+        if (jsonMarshalling)
+        {
+            nargs = pushArgs((int)L, envId, argIdx);
+        }
+        else
+        {
+            nargs = writeArgs((int)L, envId, argIdx);
+            pushWebValues(L, nargs, "<callarg>");
+        }
 
         int status = lua_pcall(L, nargs, LUA_MULTRET, 0);
 
-        std::string retJson = "[";
-
         if (status == LUA_OK)
         {
-            int newTop = lua_gettop(L);
-            int nresults = newTop - top;
-
-            for (int i = 1; i <= nresults; i++)
-            {
-                int ref = LUA_NOREF;
-                retJson += serializeLuaValue(L, top + i, &ref);
-
-                if (i < nresults)
-                {
-                    retJson += ",";
-                }
-            }
+            setMultretResults(L, envId, top, argIdx);
         }
         else
         {
             const char* errMsg = lua_tostring(L, -1);
-            retJson += "{\"error\":\"" + escapeJsonString(errMsg ? errMsg : "unknown error") + "\"}";
+            setMultretError(L, envId, errMsg ? errMsg : "unknown error", argIdx);
         }
 
-        retJson += "]";
-
         lua_settop(L, top);
-        setMultretData((int)L, envId, retJson.c_str(), argIdx);
-
+        flushJSReleases();
         return status;
     }
     catch (const std::exception& e)
@@ -1816,9 +3686,8 @@ extern "C" int luaPcall(lua_State* L, int ref, int argIdx)
         L->nCcalls = savedNcalls;
         L->baseCcalls = savedBaseCcalls;
 
+        setMultretError(L, envId, errMsg ? errMsg : e.what(), argIdx);
         lua_settop(L, top);
-        std::string errorJson = "[{\"error\":\"" + escapeJsonString(errMsg ? errMsg : e.what()) + "\"}]";
-        setMultretData((int)L, envId, errorJson.c_str(), argIdx);
         return LUA_ERRRUN;
     }
     catch (...)
@@ -1832,13 +3701,89 @@ extern "C" int luaPcall(lua_State* L, int ref, int argIdx)
         L->nCcalls = savedNcalls;
         L->baseCcalls = savedBaseCcalls;
 
+        setMultretError(L, envId, errMsg ? errMsg : "unknown error", argIdx);
         lua_settop(L, top);
-        std::string errorJson = "[{\"error\":\"" + escapeJsonString(errMsg ? errMsg : "unknown error") + "\"}]";
-        setMultretData((int)L, envId, errorJson.c_str(), argIdx);
         return LUA_ERRRUN;
     }
 }
 
+// starts a cooperative call, the function stays on the new thread until the first luaResumeCall
+extern "C" int luaNewCallThread(lua_State* L, int ref)
+{
+    lua_State* co = lua_newthread(L);
+    int threadRef = lua_ref(L, -1);
+    lua_pop(L, 1);
+
+    lua_getref(co, ref);
+    getWebState(L)->callThreads.insert(co);
+
+    return threadRef;
+}
+
+// resumes a call thread with the values at argIdx, or raises the first one as an error at the pending await;
+// returns LUA_YIELD while the call waits on js, otherwise the results or error are left at argIdx like luaPcall
+extern "C" int luaResumeCall(lua_State* L, int threadRef, int argIdx, int isError)
+{
+    WebState* ws = getWebState(L);
+    ScopedLuaSlice slice(ws);
+
+    lua_getref(L, threadRef);
+    lua_State* co = lua_tothread(L, -1);
+    lua_pop(L, 1);
+
+    int nargs = 0;
+    if (jsonMarshalling)
+    {
+        nargs = pushArgs((int)co, ws->envId, argIdx);
+    }
+    else
+    {
+        nargs = writeArgs((int)co, ws->envId, argIdx);
+        pushWebValues(co, nargs, "<callarg>");
+    }
+
+    int status = isError ? lua_resumeerror(co, L) : lua_resume(co, L, nargs);
+    if (status == LUA_YIELD)
+        return status;
+
+    if (status == LUA_OK)
+    {
+        setMultretResults(co, ws->envId, 0, argIdx);
+    }
+    else
+    {
+        const char* errMsg = lua_tostring(co, -1);
+        setMultretError(co, ws->envId, errMsg ? errMsg : "unknown error", argIdx);
+    }
+
+    ws->callThreads.erase(co);
+    lua_unref(L, threadRef);
+
+    flushJSReleases();
+    return status;
+}
+
+// jsRefId 0 drops the whole cache
+extern "C" void invalidatePropertyCache(lua_State* L, int jsRefId)
+{
+    WebState* ws = getWebState(L);
+    if (ws->propertyCacheRef == LUA_NOREF)
+        return;
+
+    if (jsRefId == 0)
+    {
+        lua_unref(L, ws->propertyCacheRef);
+        ws->propertyCacheRef = LUA_NOREF;
+        ws->stalePropertyCaches.clear();
+        return;
+    }
+
+    lua_getref(L, ws->propertyCacheRef);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, jsRefId);
+    lua_pop(L, 1);
+}
+
 extern "C" int luaCloneref(lua_State* L, int ref)
 {
     lua_getref(L, ref);
@@ -1857,44 +3802,213 @@ extern "C" void luaUnref(lua_State* L, int ref)
     const void* ptr = lua_topointer(L, -1);
     lua_pop(L, 1);
 
-    if (ptr)
+    WebState* ws = getWebState(L);
+    auto it = ptr ? ws->refCache.find(ptr) : ws->refCache.end();
+    if (it != ws->refCache.end() && it->second == ref)
     {
-        refCache.erase(ptr);
+        ws->refCache.erase(it);
     }
 
     lua_unref(L, ref);
 }
 
-// clang-format off
-EM_JS(int, sendValueToJS, (int envId, const char* valueJson), {
-    const value = JSON.parse(UTF8ToString(valueJson));
-    const key = Module.states[envId].nextTXKey++;
+// address and length of a buffer held by js, valid for as long as the ref is
+extern "C" uint32_t* luaBufferRegion(lua_State* L, int ref)
+{
+    static uint32_t region[2];
+
+    lua_getref(L, ref);
+    size_t len = 0;
+    void* data = lua_tobuffer(L, -1, &len);
+    lua_pop(L, 1);
+
+    region[0] = uint32_t(uintptr_t(data));
+    region[1] = uint32_t(len);
+    return region;
+}
+
+extern "C" int luaNewBuffer(lua_State* L, int size)
+{
+    if (size < 0 || size_t(size) > MAX_BUFFER_SIZE)
+        return -1;
+
+    lua_newbuffer(L, size);
+    int ref = lua_ref(L, -1);
+    lua_pop(L, 1);
+    return ref;
+}
+
+static std::vector<int32_t> webRefScratch;
+
+extern "C" int32_t* webReserveRefs(int count)
+{
+    if (webRefScratch.size() < size_t(count))
+        webRefScratch.resize(count);
+
+    return webRefScratch.data();
+}
+
+// releases registry refs of LuaValues collected by js, see Module.flushLuaUnrefs
+extern "C" void luaUnrefBatch(lua_State* L, const int32_t* refs, int count)
+{
+    for (int i = 0; i < count; i++)
+        luaUnref(L, refs[i]);
+}
+
+struct WebInteropStats
+{
+    int32_t jsrefs;            // distinct js values referenced from lua
+    int32_t jsproxies;         // live jsref userdata
+    int32_t pendingJSReleases; // collected by lua but not handed back to js yet
+    int32_t cachedLuaRefs;     // registry refs cached for values sent to js
+};
+
+extern "C" WebInteropStats* getInteropStats(lua_State* L)
+{
+    static WebInteropStats stats;
+    stats = {};
+
+    WebState* ws = getWebState(L);
+
+    stats.jsrefs = int32_t(ws->jsrefCounts.size());
+    for (auto& [id, count] : ws->jsrefCounts)
+        stats.jsproxies += count;
+
+    for (size_t i = 0; i < pendingJSReleases.size(); i += 2)
+        if (pendingJSReleases[i] == ws->envId)
+            stats.pendingJSReleases++;
+
+    stats.cachedLuaRefs = int32_t(ws->refCache.size());
+    return &stats;
+}
+
+extern "C" int luaIndex(lua_State* L, int lref, const char* KT, const char* KV)
+{
+    int envId = getEnvId(L);
+    if (envId == -1)
+    {
+        fprinterr("illegal state: no environment id found for lua state");
+        return -1;
+    }
+
+    lua_getref(L, lref);
+    pushValueToLua(L, KT, KV, "<indexarg>");
+
+    lua_rawget(L, -2);
+
+    if (!jsonMarshalling)
+    {
+        WebValue* value = webReserveValues(1);
+        encodeLuaValue(L, -1, value);
+
+        int transactionKey = sendWebValueToJS((int)L, envId, value);
+        lua_pop(L, 2);
+        return transactionKey;
+    }
+
+    int ref = LUA_NOREF;
+    std::string valueJson = serializeLuaValue(L, -1, &ref);
+
+    lua_pop(L, 2);
+    return sendValueToJS(envId, valueJson.c_str());
+}
+
+extern "C" int luaIndexById(lua_State* L, int lref, int keyId)
+{
+    int envId = getEnvId(L);
+    if (envId == -1)
+    {
+        fprinterr("illegal state: no environment id found for lua state");
+        return -1;
+    }
+
+    lua_getref(L, lref);
+    if (!pushKey(L, keyId))
+        lua_pushnil(L);
+
+    lua_rawget(L, -2);
+
+    WebValue* value = webReserveValues(1);
+    encodeLuaValue(L, -1, value);
+
+    int transactionKey = sendWebValueToJS((int)L, envId, value);
+    lua_pop(L, 2);
+    return transactionKey;
+}
+
+// the key is the first entry of the value scratch, written by Module.writeWebValues
+extern "C" int luaIndexValue(lua_State* L, int lref)
+{
+    int envId = getEnvId(L);
+    if (envId == -1)
+    {
+        fprinterr("illegal state: no environment id found for lua state");
+        return -1;
+    }
+
+    lua_getref(L, lref);
+    pushWebValues(L, 1, "<indexarg>");
+
+    lua_rawget(L, -2);
+
+    WebValue* value = webReserveValues(1);
+    encodeLuaValue(L, -1, value);
+
+    int transactionKey = sendWebValueToJS((int)L, envId, value);
+    lua_pop(L, 2);
+    return transactionKey;
+}
+
+// the value is the first entry of the value scratch, written by Module.writeWebValues
+extern "C" bool luaNewIndexById(lua_State* L, int lref, int keyId, bool bypassReadonly)
+{
+    lua_getref(L, lref);
+
+    bool readonly = lua_getreadonly(L, -1) == 1;
+    if ((readonly && !bypassReadonly) || !pushKey(L, keyId))
+    {
+        lua_pop(L, 1);
+        return false;
+    }
+
+    pushWebValues(L, 1, keyNames[keyId].c_str());
+
+    if (readonly)
+        lua_setreadonly(L, -3, 0);
+
+    lua_rawset(L, -3);
 
-    Module.states[envId].transactionData[key] = value;
+    if (readonly)
+        lua_setreadonly(L, -1, 1);
 
-    return key;
-});
-// clang-format on
+    lua_pop(L, 1);
+    return true;
+}
 
-extern "C" int luaIndex(lua_State* L, int lref, const char* KT, const char* KV)
+// key and value are the first two entries of the value scratch, written by Module.writeWebValues
+extern "C" bool luaNewIndexValue(lua_State* L, int lref, bool bypassReadonly)
 {
-    int envId = getEnvId(L);
-    if (envId == -1)
+    lua_getref(L, lref);
+
+    bool readonly = lua_getreadonly(L, -1) == 1;
+    if (readonly && !bypassReadonly)
     {
-        fprinterr("illegal state: no environment id found for lua state");
-        return -1;
+        lua_pop(L, 1);
+        return false;
     }
 
-    lua_getref(L, lref);
-    pushValueToLua(L, KT, KV, "<indexarg>");
+    pushWebValues(L, 2, "<indexarg>");
 
-    lua_rawget(L, -2);
+    if (readonly)
+        lua_setreadonly(L, -3, 0);
 
-    int ref = LUA_NOREF;
-    std::string valueJson = serializeLuaValue(L, -1, &ref);
+    lua_rawset(L, -3);
 
-    lua_pop(L, 2);
-    return sendValueToJS(envId, valueJson.c_str());
+    if (readonly)
+        lua_setreadonly(L, -1, 1);
+
+    lua_pop(L, 1);
+    return true;
 }
 
 extern "C" bool luaNewIndex(lua_State* L, int lref, const char* KT, const char* KV, const char* VT, const char* VV, bool bypassReadonly)
@@ -1947,7 +4061,27 @@ extern "C" int luaKeys(lua_State* L, int lref, int argIdx)
         if (!lua_istable(L, -1))
         {
             lua_pop(L, 1);
-            setMultretData((int)L, envId, "[]", argIdx);
+            if (jsonMarshalling)
+                setMultretData((int)L, envId, "[]", argIdx);
+            else
+                setMultretBinary((int)L, envId, nullptr, 0, argIdx);
+            return 0;
+        }
+
+        if (!jsonMarshalling)
+        {
+            // string keys point into the table, which stays on the stack until js has read them
+            std::vector<WebValue> keys;
+
+            lua_pushnil(L);
+            while (lua_next(L, -2))
+            {
+                lua_pop(L, 1);
+                encodeLuaValue(L, -1, &keys.emplace_back());
+            }
+
+            setMultretBinary((int)L, envId, keys.data(), int(keys.size()), argIdx);
+            lua_settop(L, top);
             return 0;
         }
 
@@ -1979,12 +4113,36 @@ extern "C" int luaKeys(lua_State* L, int lref, int argIdx)
     catch (const std::exception& e)
     {
         lua_settop(L, top);
-        std::string errorJson = "[{\"error\":\"" + std::string(e.what()) + "\"}]";
-        setMultretData((int)L, envId, errorJson.c_str(), argIdx);
+        setMultretError(L, envId, e.what(), argIdx);
         return 1;
     }
 }
 
+// called by the collector right before a jsref userdata is freed, so this must not touch the lua stack
+static void jsrefDestructor(lua_State* L, void* data)
+{
+    jsref_ud* ud = (jsref_ud*)data;
+    WebState* ws = ud->ws;
+
+    auto it = ws->jsrefCounts.find(ud->ref);
+    if (it == ws->jsrefCounts.end() || --it->second > 0)
+        return;
+
+    ws->jsrefCounts.erase(it);
+
+    if (ws->propertyCacheRef != LUA_NOREF)
+        ws->stalePropertyCaches.push_back(ud->ref);
+
+    pendingJSReleases.push_back(ws->envId);
+    pendingJSReleases.push_back(ud->ref);
+
+    if (ws->closed && ws->jsrefCounts.empty())
+        delete ws;
+
+    if (pendingJSReleases.size() >= kJSReleaseBatch * 2)
+        flushJSReleases();
+}
+
 static void setupState(lua_State* L)
 {
     try
@@ -2022,6 +4180,11 @@ static void setupState(lua_State* L)
         lua_setreadonly(L, -1, true);
         L->global->udatamt[UTAG_JSOBJECT] = hvalue(L->top - 1);
         lua_pop(L, 1);
+
+        lua_setuserdatadtor(L, UTAG_JSFUNC, jsrefDestructor);
+        lua_setuserdatadtor(L, UTAG_JSOBJECT, jsrefDestructor);
+
+        lua_callbacks(L)->userthread = inheritWebState;
     }
     catch (const std::exception& e)
     {
@@ -2029,40 +4192,267 @@ static void setupState(lua_State* L)
     }
 }
 
-extern "C" lua_State* makeLuaState(int envId)
+extern "C" void setBytecodeCacheLimit(int bytes);
+extern "C" void setExecutionBudget(lua_State* L, double ms, int yield);
+extern "C" void setMemoryLimit(lua_State* L, double bytes);
+
+static uint64_t webAllocCount = 0;
+
+// same as the default luaL_newstate allocator, but tracks the bytes of each state against its limit and counts
+// allocations for bench/web; a failed allocation surfaces in lua as a catchable "not enough memory" error
+static void* webAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
 {
-    // setup flags
+    WebAllocator* alloc = (WebAllocator*)ud;
+
+    if (nsize == 0)
+    {
+        free(ptr);
+        alloc->current -= osize;
+        return nullptr;
+    }
+
+    if (alloc->limit && nsize > osize && alloc->current - osize + nsize > alloc->limit)
+        return nullptr;
+
+    // the category total is only updated once the allocation returns, so the growth is added here
+    int cat = alloc->activeMemcat;
+    size_t catBytes = cat != 0 && nsize > osize ? alloc->global->memcatbytes[cat] + (nsize - osize) : 0;
+
+    if (alloc->memcatLimit[cat] && catBytes > alloc->memcatLimit[cat])
+        return nullptr;
+
+    void* result = realloc(ptr, nsize);
+    if (!result)
+        return nullptr;
+
+    alloc->current = alloc->current - osize + nsize;
+    alloc->peak = std::max(alloc->peak, alloc->current);
+    alloc->memcatPeak[cat] = std::max(alloc->memcatPeak[cat], catBytes);
+
+    webAllocCount++;
+    return result;
+}
+
+// memory categories handed to forked sandboxes, category 0 is the template itself
+static bool memcatInUse[LUA_MEMORY_CATEGORIES];
+
+static int acquireMemoryCategory(lua_State* T)
+{
+    // prefer categories whose previous sandbox has been fully collected so its garbage is not counted again
+    int cat = 0;
+    for (int candidate = 1; candidate < LUA_MEMORY_CATEGORIES; candidate++)
+    {
+        if (memcatInUse[candidate])
+            continue;
+
+        bool collected = lua_totalbytes(T, candidate) == 0;
+        if (!cat || collected)
+            cat = candidate;
+
+        if (collected)
+            break;
+    }
+
+    if (!cat)
+    {
+        fprintwarn("illegal state: out of memory categories, sandbox memory is accounted to the template state");
+        return 0;
+    }
+
+    memcatInUse[cat] = true;
+    templateAllocator.memcatLimit[cat] = 0;
+    templateAllocator.memcatPeak[cat] = lua_totalbytes(T, cat);
+    return cat;
+}
+
+extern "C" double getAllocationCount()
+{
+    return double(webAllocCount);
+}
+
+static void enableLuauFlags()
+{
+    static bool enabled = false;
+    if (enabled)
+        return;
+
     for (Luau::FValue<bool>* flag = Luau::FValue<bool>::list; flag; flag = flag->next)
         if (strncmp(flag->name, "Luau", 4) == 0)
             flag->value = true;
 
-    // create new state
-    lua_State* L = luaL_newstate();
+    enabled = true;
+}
+
+// fully initialized state whose frozen globals are shared by every sandbox forked from it, see LUA_TEMPLATE_STATE
+static lua_State* templateState = nullptr;
+
+static lua_State* getTemplateState()
+{
+    if (!templateState)
+    {
+        templateState = lua_newstate(webAlloc, &templateAllocator);
+        templateAllocator.global = templateState->global;
+        lua_callbacks(templateState)->userdata = new WebState();
+
+        // luaL_sandbox makes the globals and builtin libraries read-only, so forks can share them safely
+        setupState(templateState);
+    }
+
+    return templateState;
+}
+
+static lua_State* forkTemplateState(WebState* ws)
+{
+    lua_State* T = getTemplateState();
 
-    // setup state
-    setupState(L);
+    ws->memcat = acquireMemoryCategory(T);
+    lua_setmemcat(T, ws->memcat);
+    lua_State* L = lua_newthread(T);
+    lua_setmemcat(T, 0);
 
-    // save globals
-    int globalsRef = saveOriginalGlobalsRef(L);
+    ws->threadRef = lua_ref(T, -1);
+    lua_pop(T, 1);
 
-    // sandbox thread and globals
+    lua_setthreaddata(L, ws);
     luaL_sandboxthread(L);
 
-    // save fake globals
-    int fakeGlobalsRef = saveSandboxedGlobalsRef(L);
+    // the shared globals are frozen, so the js side only ever sees the sandbox globals
+    ws->globalsRef = saveSandboxedGlobalsRef(L);
+    return L;
+}
+
+extern "C" lua_State* makeLuaState(int envId)
+{
+    // setup flags
+    enableLuauFlags();
 
     // check for env (only for web/emscripten)
     ensureInterop();
+    ensureInteropState(envId);
+    jsonMarshalling = useJsonMarshalling();
+
+    WebState* ws = new WebState();
+    ws->bytecodeOnly = getIntOption("LUA_BYTECODE_ONLY", 0) != 0;
+    ws->cooperative = getIntOption("LUA_COOPERATIVE_SCHEDULER", 0) != 0;
+    ws->optimizationLevel = getIntOption("LUA_OPTIMIZATION_LEVEL", 1);
+    ws->debugLevel = getIntOption("LUA_DEBUG_LEVEL", 1);
+    ws->budgetYield = getIntOption("LUA_TIME_BUDGET_YIELD", 0) != 0;
+
+    int cacheLimit = getIntOption("LUA_BYTECODE_CACHE_SIZE", -1);
+    if (cacheLimit >= 0)
+        setBytecodeCacheLimit(cacheLimit);
+
+    lua_State* L;
+    if (getIntOption("LUA_TEMPLATE_STATE", 0))
+    {
+        L = forkTemplateState(ws);
+    }
+    else
+    {
+        // create new state
+        L = lua_newstate(webAlloc, &ws->allocator);
+        lua_callbacks(L)->userdata = ws;
+
+        // setup state
+        setupState(L);
+
+        // save globals
+        saveOriginalGlobalsRef(L);
+
+        // sandbox thread and globals
+        luaL_sandboxthread(L);
+
+        // save fake globals
+        saveSandboxedGlobalsRef(L);
+    }
 
     if (envId != 0)
     {
         setEnvId(L, envId);
-        setEnvFromJS((int)L, envId, globalsRef, fakeGlobalsRef);
+        setEnvFromJS((int)L, envId, ws->globalsRef, ws->fakeGlobalsRef);
     }
 
+    int budgetMs = getIntOption("LUA_TIME_BUDGET_MS", 0);
+    if (budgetMs > 0)
+        setExecutionBudget(L, budgetMs, ws->budgetYield);
+
+    // the builtin libraries are allocated by now, so the limit only has to fit what the sandbox does with them
+    int memoryLimit = getIntOption("LUA_MEMORY_LIMIT", 0);
+    if (memoryLimit > 0)
+        setMemoryLimit(L, memoryLimit);
+
     return L;
 }
 
+// ms 0 removes the budget, yield picks yielding call threads over raising an error once a slice runs out
+extern "C" void setExecutionBudget(lua_State* L, double ms, int yield)
+{
+    WebState* ws = getWebState(L);
+    ws->budgetMs = ms;
+    ws->budgetYield = yield != 0;
+
+    // the interrupt is per vm and shared by forked sandboxes, so it stays installed once any state has a budget
+    if (ms > 0)
+        lua_callbacks(L)->interrupt = webInterrupt;
+}
+
+extern "C" double getExecutionTime(lua_State* L)
+{
+    return getWebState(L)->executionTime;
+}
+
+// bytes 0 removes the limit
+extern "C" void setMemoryLimit(lua_State* L, double bytes)
+{
+    WebState* ws = getWebState(L);
+    ws->memoryLimit = size_t(bytes);
+
+    // forked sandboxes allocate from the template allocator, which checks the budget of their category
+    if (ws->memcat != 0)
+        templateAllocator.memcatLimit[ws->memcat] = ws->memoryLimit;
+    else
+        ws->allocator.limit = ws->memoryLimit;
+}
+
+// current, peak and limit followed by (category, bytes) pairs for every category in use, as doubles
+static std::vector<double> memoryStatsScratch;
+
+extern "C" double* getMemoryStats(lua_State* L)
+{
+    WebState* ws = getWebState(L);
+    memoryStatsScratch.clear();
+
+    if (ws->memcat != 0)
+    {
+        size_t bytes = lua_totalbytes(L, ws->memcat);
+        size_t peak = std::max(templateAllocator.memcatPeak[ws->memcat], bytes);
+
+        memoryStatsScratch.insert(
+            memoryStatsScratch.end(), {double(bytes), double(peak), double(ws->memoryLimit), double(ws->memcat), double(bytes)}
+        );
+    }
+    else
+    {
+        memoryStatsScratch.insert(memoryStatsScratch.end(), {double(ws->allocator.current), double(ws->allocator.peak), double(ws->memoryLimit)});
+
+        for (int cat = 0; cat < LUA_MEMORY_CATEGORIES; cat++)
+        {
+            if (size_t bytes = lua_totalbytes(L, cat))
+                memoryStatsScratch.insert(memoryStatsScratch.end(), {double(cat), double(bytes)});
+        }
+    }
+
+    // the count of values comes first so js knows how many pairs follow
+    memoryStatsScratch.insert(memoryStatsScratch.begin(), double(memoryStatsScratch.size()));
+    return memoryStatsScratch.data();
+}
+
+// lua_gc for the host, e.g. an incremental step between requests; forked sandboxes drive the shared template heap
+extern "C" int luaGc(lua_State* L, int what, int data)
+{
+    return lua_gc(L, what, data);
+}
+
 // clang-format off
 EM_JS(char*, acceptStringTransaction, (int envIdx, int transactionIdx), {
     const source = Module.states[envIdx].transactionData[transactionIdx] || "none";
@@ -2078,20 +4468,97 @@ EM_JS(char*, acceptStringTransaction, (int envIdx, int transactionIdx), {
 
 struct ScopedLoadFlag
 {
-    lua_State* L;
+    WebState* ws;
     ScopedLoadFlag(lua_State* L)
-        : L(L)
+        : ws(getWebState(L))
     {
-        lua_pushboolean(L, 1);
-        lua_setfield(L, LUA_REGISTRYINDEX, "LUAU_WEB_LOADING");
+        ws->loading = true;
     }
     ~ScopedLoadFlag()
     {
-        lua_pushnil(L);
-        lua_setfield(L, LUA_REGISTRYINDEX, "LUAU_WEB_LOADING");
+        ws->loading = false;
     }
 };
 
+// compiled chunks shared by every state, so sandboxes loading the same script only compile it once
+struct BytecodeCacheEntry
+{
+    uint64_t key;
+    std::string source;
+    std::string bytecode;
+};
+
+static std::list<BytecodeCacheEntry> bytecodeCache; // most recently used first
+static std::unordered_map<uint64_t, std::list<BytecodeCacheEntry>::iterator> bytecodeCacheIndex;
+static size_t bytecodeCacheBytes = 0;
+static size_t bytecodeCacheLimit = 16 * 1024 * 1024;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+    return hash;
+}
+
+static void trimBytecodeCache(size_t limit)
+{
+    while (bytecodeCacheBytes > limit && !bytecodeCache.empty())
+    {
+        BytecodeCacheEntry& entry = bytecodeCache.back();
+        bytecodeCacheBytes -= entry.source.size() + entry.bytecode.size();
+        bytecodeCacheIndex.erase(entry.key);
+        bytecodeCache.pop_back();
+    }
+}
+
+static const std::string& compileCached(WebState* ws, const char* source, size_t sourceSize)
+{
+    lua_CompileOptions options = {};
+    options.optimizationLevel = ws->optimizationLevel;
+    options.debugLevel = ws->debugLevel;
+
+    uint64_t key = fnv1a(14695981039346656037ull, &options.optimizationLevel, sizeof(options.optimizationLevel));
+    key = fnv1a(key, &options.debugLevel, sizeof(options.debugLevel));
+    key = fnv1a(key, source, sourceSize);
+
+    auto it = bytecodeCacheIndex.find(key);
+    if (it != bytecodeCacheIndex.end() && it->second->source.compare(0, std::string::npos, source, sourceSize) == 0)
+    {
+        bytecodeCache.splice(bytecodeCache.begin(), bytecodeCache, it->second);
+        return it->second->bytecode;
+    }
+
+    size_t bytecodeSize = 0;
+    char* bytecode = luau_compile(source, sourceSize, &options, &bytecodeSize);
+
+    // a colliding entry is replaced rather than chained, collisions are not worth optimizing for
+    if (it != bytecodeCacheIndex.end())
+    {
+        bytecodeCacheBytes -= it->second->source.size() + it->second->bytecode.size();
+        bytecodeCache.erase(it->second);
+        bytecodeCacheIndex.erase(it);
+    }
+
+    bytecodeCache.push_front({key, std::string(source, sourceSize), std::string(bytecode, bytecodeSize)});
+    bytecodeCacheIndex[key] = bytecodeCache.begin();
+    bytecodeCacheBytes += sourceSize + bytecodeSize;
+    free(bytecode);
+
+    // the new entry stays even if it is larger than the limit on its own, it is evicted by the next insertion
+    BytecodeCacheEntry* front = &bytecodeCache.front();
+    trimBytecodeCache(std::max(bytecodeCacheLimit, front->source.size() + front->bytecode.size()));
+
+    return front->bytecode;
+}
+
+extern "C" void setBytecodeCacheLimit(int bytes)
+{
+    bytecodeCacheLimit = bytes < 0 ? 0 : size_t(bytes);
+    trimBytecodeCache(bytecodeCacheLimit);
+}
+
 extern "C" int luauLoad(lua_State* L, int sourceIdx, int chunkNameIdx)
 {
     int envId = getEnvId(L);
@@ -2114,26 +4581,157 @@ extern "C" int luauLoad(lua_State* L, int sourceIdx, int chunkNameIdx)
 
     if (!chunkName || chunkName == nullptr)
     {
+        free(source);
         fprinterr("failed to accept chunkName from transaction");
         lua_pushstring(L, "failed to accept chunkName from transaction");
         return -1;
     }
 
-    size_t bytecodeSize = 0;
-    char* bytecode = luau_compile(source, strlen(source), nullptr, &bytecodeSize);
+    WebState* ws = getWebState(L);
+    if (ws->bytecodeOnly)
+    {
+        free(source);
+        free(chunkName);
+        lua_pushstring(L, "loading source is disabled, use luauLoadBytecode");
+        return -1;
+    }
+
+    int result;
+    if (bytecodeCacheLimit > 0)
+    {
+        const std::string& bytecode = compileCached(ws, source, strlen(source));
+
+        ScopedLoadFlag loadFlag(L);
+        result = luau_load(L, chunkName, bytecode.data(), bytecode.size(), 0);
+    }
+    else
+    {
+        lua_CompileOptions options = {};
+        options.optimizationLevel = ws->optimizationLevel;
+        options.debugLevel = ws->debugLevel;
+
+        size_t bytecodeSize = 0;
+        char* bytecode = luau_compile(source, strlen(source), &options, &bytecodeSize);
+
+        ScopedLoadFlag loadFlag(L);
+        result = luau_load(L, chunkName, bytecode, bytecodeSize, 0);
+        free(bytecode);
+    }
+
     free(source);
+    free(chunkName);
+    return result;
+}
+
+// loads bytecode compiled ahead of time, e.g. with luau-compile --binary; the host owns the bytecode buffer
+extern "C" int luauLoadBytecode(lua_State* L, const char* bytecode, int bytecodeSize, int chunkNameIdx)
+{
+    int envId = getEnvId(L);
+    if (envId == -1)
+    {
+        fprinterr("illegal state: no environment id found for lua state");
+        lua_pushstring(L, "failed to find state");
+        return -1;
+    }
+
+    char* chunkName = acceptStringTransaction(envId, chunkNameIdx);
+    if (!chunkName || chunkName == nullptr)
+    {
+        fprinterr("failed to accept chunkName from transaction");
+        lua_pushstring(L, "failed to accept chunkName from transaction");
+        return -1;
+    }
 
     ScopedLoadFlag loadFlag(L);
 
     int result = luau_load(L, chunkName, bytecode, bytecodeSize, 0);
-    free(bytecode);
+    free(chunkName);
 
     return result;
 }
 
+// clang-format off
+EM_JS(void, closeInteropState, (int L_ptr, int envId, int releaseRefs), {
+    if (!Module.states[envId]) {
+        return;
+    }
+
+    const state = Module.states[envId];
+    const interop = Module.interopState(envId);
+
+    // forks share the template registry, so refs held by js have to be returned before the sandbox goes away
+    if (releaseRefs) {
+        const refs = new Set(interop.pendingUnrefs);
+        for (const ref of state.luaValueCache.keys()) {
+            refs.add(ref);
+        }
+
+        if (refs.size > 0) {
+            const ptr = _webReserveRefs(refs.size);
+            HEAP32.set([...refs], ptr >> 2);
+            _luaUnrefBatch(L_ptr, ptr, refs.size);
+        }
+    }
+
+    interop.closed = true;
+    interop.pendingUnrefs.clear();
+    state.luaValueCache.clear();
+});
+// clang-format on
+
+static void closeForkedState(lua_State* L, WebState* ws)
+{
+    if (ws->envId != -1)
+        closeInteropState((int)L, ws->envId, 1);
+
+    for (auto& [ptr, ref] : ws->refCache)
+        lua_unref(L, ref);
+    ws->refCache.clear();
+
+    for (int ref : ws->keyRefs)
+        if (ref != LUA_NOREF)
+            lua_unref(L, ref);
+    ws->keyRefs.clear();
+
+    lua_unref(L, ws->globalsRef);
+    if (ws->propertyCacheRef != LUA_NOREF)
+        lua_unref(L, ws->propertyCacheRef);
+    lua_resetthread(L);
+
+    // the thread is collected with the rest of the sandbox once unanchored
+    lua_unref(L, ws->threadRef);
+
+    if (ws->memcat != 0)
+    {
+        memcatInUse[ws->memcat] = false;
+        templateAllocator.memcatLimit[ws->memcat] = 0;
+    }
+
+    // jsref userdata of this sandbox may outlive it until the next collection
+    ws->closed = true;
+    if (ws->jsrefCounts.empty())
+        delete ws;
+}
+
 extern "C" void luauClose(lua_State* L)
 {
-    lua_close(L);
+    WebState* ws = getWebState(L);
+
+    if (ws->threadRef != LUA_NOREF)
+    {
+        closeForkedState(L, ws);
+    }
+    else
+    {
+        if (ws->envId != -1)
+            closeInteropState((int)L, ws->envId, 0);
+
+        // userdata destructors still need the bookkeeping while the state is torn down
+        lua_close(L);
+        delete ws;
+    }
+
+    flushJSReleases();
 }
 
 extern "C" bool isreadonly(lua_State* L, int lref)
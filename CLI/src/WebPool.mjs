@@ -0,0 +1,466 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// runs independent sandboxes of a Luau.Web.* build across node worker_threads
+//
+// every state lives on one worker for its whole life (sticky placement by envId), calls and table reads are proxied
+// over the worker's message port and host functions passed in as globals stay on the main thread behind an rpc shim.
+// values cross the port with the structured clone (binary) encoding, lua tables and functions cross as handles.
+//
+// usage:
+//   const pool = await LuauPool.create("Luau.Web.JSPI.Wasm.js", { workers: 8, options: { LUA_COOPERATIVE_SCHEDULER: true } });
+//   const state = await pool.createState({ print: (...args) => console.log(...args) });
+//   const fn = await state.load("return function(n) return n * 2 end");
+//   const [double] = await fn.call();
+//   const [result] = await double.call(21);
+//   await state.close();
+//   await pool.close();
+import os from "node:os";
+import path from "node:path";
+import { existsSync } from "node:fs";
+import { readFile } from "node:fs/promises";
+import { pathToFileURL } from "node:url";
+import { Worker, isMainThread, parentPort, workerData } from "node:worker_threads";
+
+// marker key for values that are handles rather than plain data
+const HANDLE = "$luauHandle";
+
+function isPlainObject(value) {
+    const proto = Object.getPrototypeOf(value);
+    return proto === Object.prototype || proto === null;
+}
+
+// walks arrays and plain objects, everything else is either cloneable as is or turned into a handle by toHandle
+function encodeValue(value, toHandle) {
+    if (value === null || (typeof value !== "object" && typeof value !== "function")) {
+        return value;
+    }
+
+    const handle = toHandle(value);
+    if (handle) {
+        return { [HANDLE]: handle };
+    }
+
+    if (Array.isArray(value)) {
+        return value.map((item) => encodeValue(item, toHandle));
+    }
+
+    if (typeof value === "object" && isPlainObject(value)) {
+        const out = {};
+        for (const [key, item] of Object.entries(value)) {
+            out[key] = encodeValue(item, toHandle);
+        }
+        return out;
+    }
+
+    return value;
+}
+
+function decodeValue(value, fromHandle) {
+    if (value === null || typeof value !== "object") {
+        return value;
+    }
+
+    if (Object.hasOwn(value, HANDLE)) {
+        return fromHandle(value[HANDLE]);
+    }
+
+    if (Array.isArray(value)) {
+        return value.map((item) => decodeValue(item, fromHandle));
+    }
+
+    if (isPlainObject(value)) {
+        const out = {};
+        for (const [key, item] of Object.entries(value)) {
+            out[key] = decodeValue(item, fromHandle);
+        }
+        return out;
+    }
+
+    return value;
+}
+
+// request/reply bookkeeping shared by both ends of a port
+class Channel {
+    constructor(port, onRequest) {
+        this.port = port;
+        this.pending = new Map();
+        this.nextId = 1;
+
+        port.on("message", async (message) => {
+            if (message.op === "reply") {
+                const pending = this.pending.get(message.id);
+                if (!pending) {
+                    return;
+                }
+                this.pending.delete(message.id);
+                if (message.ok) {
+                    pending.resolve(message.value);
+                } else {
+                    pending.reject(new Error(message.error));
+                }
+                return;
+            }
+
+            try {
+                const value = await onRequest(message);
+                port.postMessage({ op: "reply", id: message.id, ok: true, value });
+            } catch (e) {
+                port.postMessage({ op: "reply", id: message.id, ok: false, error: (e && e.message) ? e.message : String(e) });
+            }
+        });
+    }
+
+    request(message) {
+        if (this.error) {
+            return Promise.reject(this.error);
+        }
+
+        const id = this.nextId++;
+        return new Promise((resolve, reject) => {
+            this.pending.set(id, { resolve, reject });
+            this.port.postMessage({ ...message, id });
+        });
+    }
+
+    // the other end is gone, every outstanding and later request fails with error
+    fail(error) {
+        this.error = error;
+        for (const pending of this.pending.values()) {
+            pending.reject(error);
+        }
+        this.pending.clear();
+    }
+}
+
+// main thread side of a lua table or function living on a worker
+export class LuauPoolRef {
+    constructor(state, id, type) {
+        this.state = state;
+        this.id = id;
+        this.type = type;
+    }
+
+    call(...args) {
+        return this.state.request({ op: "call", ref: this.id, args: this.state.encode(args) });
+    }
+
+    get(key) {
+        return this.state.request({ op: "index", ref: this.id, key: this.state.encode(key) });
+    }
+
+    release() {
+        if (this.released) {
+            return;
+        }
+        this.released = true;
+        refRegistry.unregister(this);
+        this.state.releaseRef(this.id);
+    }
+
+    toString() {
+        return "[LuauPoolRef " + this.type + " " + this.id + "]";
+    }
+}
+
+const refRegistry = new FinalizationRegistry(({ state, id }) => state.releaseRef(id));
+
+export class LuauPoolState {
+    constructor(pool, worker, envId) {
+        this.pool = pool;
+        this.worker = worker;
+        this.envId = envId;
+        this.hostFunctions = new Map(); // id -> { fn, sent }, sent counts encodes the worker has not released yet
+        this.hostFunctionIds = new Map();
+        this.nextHostFunctionId = 1;
+        this.closed = false;
+    }
+
+    encode(value) {
+        return encodeValue(value, (item) => {
+            if (item instanceof LuauPoolRef) {
+                return { kind: "lua", id: item.id };
+            }
+            if (typeof item === "function") {
+                let id = this.hostFunctionIds.get(item);
+                if (id === undefined) {
+                    id = this.nextHostFunctionId++;
+                    this.hostFunctionIds.set(item, id);
+                    this.hostFunctions.set(id, { fn: item, sent: 0 });
+                }
+                this.hostFunctions.get(id).sent++;
+                return { kind: "host", id };
+            }
+            return null;
+        });
+    }
+
+    decode(value) {
+        return decodeValue(value, (handle) => {
+            const ref = new LuauPoolRef(this, handle.id, handle.type);
+            refRegistry.register(ref, { state: this, id: handle.id }, ref);
+            return ref;
+        });
+    }
+
+    async request(message) {
+        if (this.closed) {
+            throw new Error("attempt to use a closed state");
+        }
+        return this.decode(await this.worker.channel.request({ ...message, envId: this.envId }));
+    }
+
+    // compiles and loads source on the worker, returning the chunk as a callable ref
+    load(source, chunkName = "=pool") {
+        return this.request({ op: "load", source, chunkName });
+    }
+
+    // the worker collected its stub for host function id after receiving it count times
+    releaseHostFunction(id, count) {
+        const entry = this.hostFunctions.get(id);
+        if (!entry || (entry.sent -= count) > 0) {
+            return;
+        }
+        this.hostFunctions.delete(id);
+        this.hostFunctionIds.delete(entry.fn);
+    }
+
+    releaseRef(id) {
+        if (!this.closed) {
+            this.worker.channel.request({ op: "release", envId: this.envId, ref: id }).catch(() => {});
+        }
+    }
+
+    async close() {
+        if (this.closed) {
+            return;
+        }
+        await this.worker.channel.request({ op: "close", envId: this.envId });
+        this.closed = true;
+        this.worker.states.delete(this.envId);
+    }
+}
+
+export class LuauPool {
+    // modulePath is a Luau.Web.* build, a .Wasm build is compiled once here and shared with every worker
+    static async create(modulePath, { workers = os.availableParallelism(), options = {} } = {}) {
+        modulePath = path.resolve(modulePath);
+
+        const wasmPath = modulePath.replace(/\.js$/, ".wasm");
+        const wasmModule = existsSync(wasmPath) ? await WebAssembly.compile(await readFile(wasmPath)) : undefined;
+
+        const pool = new LuauPool();
+        pool.workers = await Promise.all(Array.from({ length: workers }, () => pool.spawn(modulePath, wasmModule, options)));
+        return pool;
+    }
+
+    constructor() {
+        this.workers = [];
+        this.nextEnvId = 1;
+    }
+
+    async spawn(modulePath, wasmModule, options) {
+        const worker = new Worker(new URL(import.meta.url), { workerData: { modulePath, wasmModule, options } });
+        const entry = { worker, states: new Map(), dead: false };
+
+        // a worker calls host functions and releases the ones it no longer holds
+        entry.channel = new Channel(worker, async (message) => {
+            const state = entry.states.get(message.envId);
+            if (message.op === "releaseHost") {
+                state?.releaseHostFunction(message.fn, message.count);
+                return;
+            }
+
+            const fn = state?.hostFunctions.get(message.fn)?.fn;
+            if (!fn) {
+                throw new Error("no host function " + message.fn + " for env id " + message.envId);
+            }
+            return state.encode(await fn(...state.decode(message.args)));
+        });
+
+        worker.on("error", (e) => this.retire(entry, e));
+        worker.on("exit", (code) => this.retire(entry, new Error("worker exited with code " + code)));
+
+        await entry.channel.request({ op: "ready" });
+        return entry;
+    }
+
+    // a worker that crashed, exited or was terminated fails its pending requests and takes its states with it
+    retire(entry, error) {
+        if (entry.dead) {
+            return;
+        }
+        entry.dead = true;
+        entry.channel.fail(error);
+
+        for (const state of entry.states.values()) {
+            state.closed = true;
+        }
+        entry.states.clear();
+    }
+
+    // places the state on the live worker with the fewest live states, it stays there until closed
+    async createState(globals = {}) {
+        const live = this.workers.filter((entry) => !entry.dead);
+        if (live.length == 0) {
+            throw new Error("no live workers in the pool");
+        }
+
+        const worker = live.reduce((best, entry) => entry.states.size < best.states.size ? entry : best);
+        const state = new LuauPoolState(this, worker, this.nextEnvId++);
+
+        worker.states.set(state.envId, state);
+        await worker.channel.request({ op: "create", envId: state.envId, globals: state.encode(globals) });
+        return state;
+    }
+
+    async close() {
+        const workers = this.workers;
+        this.workers = [];
+
+        for (const entry of workers) {
+            this.retire(entry, new Error("pool was closed"));
+        }
+        await Promise.all(workers.map((entry) => entry.worker.terminate()));
+    }
+}
+
+// worker side, hosts the module and mirrors the state setup the luau-web wrapper does on the main thread
+async function runWorker({ modulePath, wasmModule, options }) {
+    const factory = (await import(pathToFileURL(modulePath).href)).default;
+    const Module = await factory(wasmModule ? { wasmModule } : {});
+
+    Module.LUA_VALUE = Symbol("LuaValue");
+    Module.JS_VALUE = Symbol("JsValue");
+    Module.JS_MUTABLE = Symbol("JsMutable");
+    Module.states = {};
+    Module.options = new Map(Object.entries(options));
+
+    // envId -> { L, handles, nextHandle, hostStubs }
+    const states = new Map();
+
+    // the main thread keeps a host function until every copy it sent is accounted for, so a collected stub reports
+    // how many times it was received
+    const hostRegistry = new FinalizationRegistry(({ envId, id, stub }) => {
+        const state = states.get(envId);
+        if (!state) {
+            return;
+        }
+        if (state.hostStubs.get(id) === stub) {
+            state.hostStubs.delete(id);
+        }
+        channel.request({ op: "releaseHost", envId, fn: id, count: stub.received }).catch(() => {});
+    });
+
+    // one stub per host function for as long as lua or a pending call holds it
+    function hostStub(envId, id) {
+        const state = states.get(envId);
+        let entry = state.hostStubs.get(id);
+        let fn = entry?.fn.deref();
+
+        if (!fn) {
+            fn = (...args) => channel.request({ op: "host", envId, fn: id, args: encode(envId, args) }).then((result) => decode(envId, result));
+            entry = { fn: new WeakRef(fn), received: 0 };
+            state.hostStubs.set(id, entry);
+            hostRegistry.register(fn, { envId, id, stub: entry });
+        }
+
+        entry.received++;
+        return fn;
+    }
+
+    function encode(envId, value) {
+        const state = states.get(envId);
+        return encodeValue(value, (item) => {
+            const data = item[Module.LUA_VALUE];
+            if (!data) {
+                return null;
+            }
+            const id = state.nextHandle++;
+            state.handles.set(id, item);
+            return { kind: "lua", id, type: data.type };
+        });
+    }
+
+    function decode(envId, value) {
+        const state = states.get(envId);
+        return decodeValue(value, (handle) => {
+            if (handle.kind === "lua") {
+                return state.handles.get(handle.id);
+            }
+            return hostStub(envId, handle.id);
+        });
+    }
+
+    function transaction(envId, value) {
+        const tx = Module.states[envId];
+        const key = tx.nextTXKey++;
+        tx.transactionData[key] = value;
+        return key;
+    }
+
+    function getHandle(envId, ref) {
+        const value = states.get(envId)?.handles.get(ref);
+        if (!value) {
+            throw new Error("no lua value " + ref + " for env id " + envId);
+        }
+        return value;
+    }
+
+    const ops = {
+        ready() {},
+
+        async create({ envId, globals }) {
+            // makeLuaState sets up Module.states[envId] through Module.createInteropState
+            states.set(envId, { L: 0, handles: new Map(), nextHandle: 1, hostStubs: new Map() });
+
+            const L = await Module.ccall("makeLuaState", "number", [ "number" ], [ envId ], { async: true });
+            states.get(envId).L = L;
+
+            for (const [key, value] of Object.entries(decode(envId, globals))) {
+                Module.setLuaGlobal(envId, key, value);
+            }
+        },
+
+        load({ envId, source, chunkName }) {
+            const L = states.get(envId).L;
+            const status = Module.ccall("luauLoad", "number", [ "number", "number", "number" ], [
+                L, transaction(envId, source), transaction(envId, chunkName)
+            ]);
+
+            const value = Module.popLuaValue(envId, L);
+            if (status != 0) {
+                throw new Error("failed to load " + chunkName + ": " + value);
+            }
+
+            return encode(envId, value);
+        },
+
+        async call({ envId, ref, args }) {
+            // decoded first so host functions in args are counted as received even if the ref is gone
+            const values = decode(envId, args);
+            return encode(envId, await Module.callLuaFunction(envId, getHandle(envId, ref), values));
+        },
+
+        index({ envId, ref, key }) {
+            return encode(envId, Module.indexLuaTable(envId, getHandle(envId, ref), decode(envId, key)));
+        },
+
+        release({ envId, ref }) {
+            const handles = states.get(envId)?.handles;
+            handles?.get(ref)?.[Module.LUA_VALUE].release();
+            handles?.delete(ref);
+        },
+
+        close({ envId }) {
+            const state = states.get(envId);
+            states.delete(envId);
+            Module.ccall("luauClose", null, [ "number" ], [ state.L ]);
+            delete Module.states[envId];
+        },
+    };
+
+    const channel = new Channel(parentPort, (message) => ops[message.op](message));
+}
+
+if (!isMainThread && workerData?.modulePath) {
+    await runWorker(workerData);
+}
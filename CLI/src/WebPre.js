@@ -0,0 +1,13 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// prepended to the Luau.Web.* builds, lets the factory start from an already compiled WebAssembly.Module passed as
+// { wasmModule } so workers can share one compilation through postMessage instead of each compiling the binary again
+if (Module["wasmModule"] instanceof WebAssembly.Module && !Module["instantiateWasm"]) {
+    Module["instantiateWasm"] = (imports, receiveInstance) => {
+        WebAssembly.instantiate(Module["wasmModule"], imports).then(
+            (instance) => receiveInstance(instance, Module["wasmModule"]),
+            (e) => abort("failed to instantiate the provided wasm module: " + e)
+        );
+
+        return {};
+    };
+}
@@ -364,6 +364,7 @@ target_sources(Luau.VM PRIVATE
     VM/src/lobject.cpp
     VM/src/loslib.cpp
     VM/src/lperf.cpp
+    VM/src/lsimd.cpp
     VM/src/lstate.cpp
     VM/src/lstring.cpp
     VM/src/lstrlib.cpp
@@ -389,6 +390,7 @@ target_sources(Luau.VM PRIVATE
     VM/src/lmem.h
     VM/src/lnumutils.h
     VM/src/lobject.h
+    VM/src/lsimd.h
     VM/src/lstate.h
     VM/src/lstring.h
     VM/src/ltable.h
@@ -611,6 +613,16 @@ if(TARGET Luau.Web.Asyncify)
         CLI/src/Web.cpp)
 endif()
 
+if(TARGET Luau.Web.JSPI.Wasm)
+    target_sources(Luau.Web.JSPI.Wasm PRIVATE
+        CLI/src/Web.cpp)
+endif()
+
+if(TARGET Luau.Web.Asyncify.Wasm)
+    target_sources(Luau.Web.Asyncify.Wasm PRIVATE
+        CLI/src/Web.cpp)
+endif()
+
 if(TARGET Luau.Reduce.CLI)
     # Luau.Reduce.CLI Sources
     target_sources(Luau.Reduce.CLI PRIVATE
@@ -293,6 +293,26 @@ enum lua_GCOp
     LUA_GCSETGOAL,
     LUA_GCSETSTEPMUL,
     LUA_GCSETSTEPSIZE,
+
+    /*
+    ** switch between incremental (data = 0) and generational (data = 1) collection, returns the previous mode
+    **
+    ** in generational mode, objects that survive a cycle become old and most cycles are minor: they only mark objects allocated since
+    ** the previous cycle, plus old objects that were changed to point to them. this suits applications that keep a large long-lived heap
+    ** and allocate a lot of short-lived garbage; old objects that die are only collected by a major cycle, which runs once the heap that
+    ** minor cycles leave behind has doubled. the switch takes effect at the end of the current cycle
+    */
+    LUA_GCSETGENERATIONAL,
+
+    /*
+    ** start (data = 1) or stop (data = 0) the background sweeper, returns whether it was running before, or -1 if it could not be started
+    **
+    ** with the background sweeper, pages emptied by the sweep and other large blocks are handed to a helper thread, which returns them
+    ** to the allocator or keeps a few of them for reuse; this takes allocator calls out of collection steps. the allocator function must
+    ** be safe to call from another thread. the sweeper is only available in native builds, elsewhere starting it fails; a failed start
+    ** leaves the collector sweeping in the foreground
+    */
+    LUA_GCSETBACKGROUNDSWEEP,
 };
 
 LUA_API int lua_gc(lua_State* L, int what, int data);
@@ -12,6 +12,7 @@
 #include "lvm.h"
 #include "lnumutils.h"
 #include "lbuffer.h"
+#include "lmem.h"
 
 #include <string.h>
 
@@ -1276,6 +1277,24 @@ int lua_gc(lua_State* L, int what, int data)
         g->gcstepsize = data << 10;
         break;
     }
+    case LUA_GCSETGENERATIONAL:
+    {
+        res = g->gcgen;
+        g->gcgen = (data != 0);
+        break;
+    }
+    case LUA_GCSETBACKGROUNDSWEEP:
+    {
+        res = g->sweeper != NULL;
+        if (data)
+        {
+            if (!luaM_startsweeper(L))
+                res = -1; // not available or could not be started
+        }
+        else
+            luaM_stopsweeper(L);
+        break;
+    }
     default:
         res = -1; // invalid option
     }
@@ -15,7 +15,7 @@
 #include <string.h>
 
 /*
- * Luau uses an incremental non-generational non-moving mark&sweep garbage collector.
+ * Luau uses an incremental non-moving mark&sweep garbage collector, with an opt-in generational mode described at the end.
  *
  * The collector runs in three stages: mark, atomic and sweep. Mark and sweep are incremental and try to do a limited amount
  * of work every GC step; atomic is ran once per the GC cycle and is indivisible. In either case, the work happens during GC
@@ -115,6 +115,17 @@
  * as black (doing so would violate the GC invariant), and they are kept in a special global list (global_State::uvhead) which is traversed
  * during atomic phase. This is needed because an open upvalue might point to a stack location in a dead thread that never marked the stack
  * slot - upvalues like this are identified since they don't have `markedopen` bit set during thread traversal and closed in `clearupvals`.
+ *
+ * In generational mode (see LUA_GCSETGENERATIONAL), the collector uses "sticky" marks instead of separate spaces for young and old
+ * objects: the sweep frees dead objects but leaves the marks of the survivors in place, which makes them old. The next cycle is minor -
+ * it only marks objects that are still white (young, allocated since the last cycle), starting from the roots and the remembered set,
+ * which holds old objects that were changed to point to young ones. This needs no new barriers: the tri-color invariant is simply kept
+ * after the sweep starts as well (see keepinvariantgen), so backward barriers put modified old tables and threads on `grayagain`, and
+ * forward barriers mark the young referent, leaving it on `gray` until the next cycle. Objects that are gray by design stay on `grayagain`
+ * from one cycle to the next: active threads need to be rescanned anyway, and weak tables need to be traversed so that their young
+ * entries are cleared. Since open upvalues of old threads aren't traversed by minor cycles, their `markedopen` bits are kept as well.
+ * Old objects that die can only be found by a major cycle. Once the heap left behind by minor cycles has grown by LUAI_GCMAJORMUL percent
+ * since the last major cycle, the sweep returns every object to white as in incremental mode and the next cycle marks the whole heap.
  */
 
 #define GC_SWEEPPAGESTEPCOST 16
@@ -216,8 +227,21 @@ static void finishGcCycleMetrics(global_State* g)
     g->gcmetrics.currcycle.endtimestamp = lua_clock();
     g->gcmetrics.currcycle.endtotalsizebytes = g->totalbytes;
 
+    g->gcmetrics.currcycle.minor = g->gcminor;
+
     g->gcmetrics.completedcycles++;
     g->gcmetrics.lastcycle = g->gcmetrics.currcycle;
+
+    if (g->gcminor)
+    {
+        g->gcmetrics.completedminorcycles++;
+        g->gcmetrics.lastminorcycle = g->gcmetrics.currcycle;
+    }
+    else
+    {
+        g->gcmetrics.lastmajorcycle = g->gcmetrics.currcycle;
+    }
+
     g->gcmetrics.currcycle = GCCycleMetrics();
 
     g->gcmetrics.currcycle.starttotalsizebytes = g->totalbytes;
@@ -741,8 +765,13 @@ static void markmt(global_State* g)
 static void markroot(lua_State* L)
 {
     global_State* g = L->global;
-    g->gray = NULL;
-    g->grayagain = NULL;
+    // when old objects kept their marks, the objects queued by barriers since the last cycle are the remembered set
+    g->gcminor = g->gcsticky;
+    if (!g->gcminor)
+    {
+        g->gray = NULL;
+        g->grayagain = NULL;
+    }
     g->weak = NULL;
     markobject(g, g->mainthread);
     // make global table be traversed before main stack
@@ -790,7 +819,8 @@ static size_t clearupvals(lua_State* L)
         {
             // upvalue is still open (belongs to alive thread)
             LUAU_ASSERT(isgray(obj2gco(uv)));
-            uv->markedopen = 0; // for next cycle
+            if (!g->gcsticky)
+                uv->markedopen = 0; // for next cycle, unless it's a minor one that might not traverse the thread
             uv = uv->u.open.next;
         }
         else
@@ -805,6 +835,36 @@ static size_t clearupvals(lua_State* L)
     return work;
 }
 
+// in generational mode, weak tables are traversed again by every minor cycle so that young objects are cleared from them
+static void rememberweak(global_State* g)
+{
+    GCObject* o = g->weak;
+    while (o)
+    {
+        LuaTable* h = gco2h(o);
+        LUAU_ASSERT(isgray(o));
+
+        GCObject* next = h->gclist;
+        h->gclist = g->grayagain;
+        g->grayagain = o;
+        o = next;
+    }
+}
+
+// decides whether the objects marked by this cycle keep their marks and become old
+static bool keepmarks(global_State* g)
+{
+    if (!g->gcgen)
+        return false;
+
+    // a major cycle has just marked everything, its survivors are the new old generation
+    if (!g->gcminor)
+        return true;
+
+    // minor cycles never free old objects, so once the heap they leave behind grows enough the next cycle has to mark everything
+    return g->gcstats.endtotalsizebytes <= g->gcstats.majorendtotalsizebytes / 100 * (100 + LUAI_GCMAJORMUL);
+}
+
 static size_t atomic(lua_State* L)
 {
     global_State* g = L->global;
@@ -812,6 +872,9 @@ static size_t atomic(lua_State* L)
 
     size_t work = 0;
 
+    // upvalue and weak table handling below depends on the kind of sweep that follows
+    g->gcsticky = keepmarks(g);
+
 #ifdef LUAI_GCMETRICS
     double currts = lua_clock();
 #endif
@@ -848,6 +911,8 @@ static size_t atomic(lua_State* L)
 
     // remove collected objects from weak tables
     work += cleartable(L, g->weak);
+    if (g->gcsticky)
+        rememberweak(g);
     g->weak = NULL;
 
 #ifdef LUAI_GCMETRICS
@@ -886,6 +951,7 @@ static int sweepgcopage(lua_State* L, lua_Page* page)
     LUAU_ASSERT(testbit(deadmask, FIXEDBIT)); // make sure we never sweep fixed objects
 
     int newwhite = luaC_white(g);
+    bool sticky = g->gcsticky;
 
     for (char* pos = start; pos != end; pos += blockSize)
     {
@@ -899,8 +965,9 @@ static int sweepgcopage(lua_State* L, lua_Page* page)
         if ((gco->gch.marked ^ WHITEBITS) & deadmask)
         {
             LUAU_ASSERT(!isdead(g, gco));
-            // make it white (for next cycle)
-            gco->gch.marked = cast_byte((gco->gch.marked & maskmarks) | newwhite);
+            // make it white (for next cycle), unless it stays marked as an old object
+            if (!sticky)
+                gco->gch.marked = cast_byte((gco->gch.marked & maskmarks) | newwhite);
         }
         else
         {
@@ -999,7 +1066,8 @@ static size_t gcstep(lua_State* L, size_t limit)
         {
             // don't forget to visit main thread, it's the only object not allocated in GCO pages
             LUAU_ASSERT(!isdead(g, obj2gco(g->mainthread)));
-            makewhite(g, obj2gco(g->mainthread)); // make it white (for next cycle)
+            if (!g->gcsticky)
+                makewhite(g, obj2gco(g->mainthread)); // make it white (for next cycle)
 
             shrinkbuffers(L);
 
@@ -1096,6 +1164,10 @@ size_t luaC_step(lua_State* L, bool assist)
     recordGcStateStep(g, lastgcstate, lua_clock() - lasttimestamp, assist, work);
 #endif
 
+    // memory released by this step is reclaimed off the mutator thread
+    if (g->sweeper)
+        luaM_flushsweeper(L);
+
     size_t actualstepsize = work * 100 / g->gcstepmul;
 
     // at the end of the last cycle
@@ -1111,6 +1183,9 @@ size_t luaC_step(lua_State* L, bool assist)
         g->gcstats.endtimestamp = lua_clock();
         g->gcstats.endtotalsizebytes = g->totalbytes;
 
+        if (!g->gcminor)
+            g->gcstats.majorendtotalsizebytes = g->totalbytes;
+
 #ifdef LUAI_GCMETRICS
         finishGcCycleMetrics(g);
 #endif
@@ -1138,10 +1213,11 @@ void luaC_fullgc(lua_State* L)
         startGcCycleMetrics(g);
 #endif
 
-    if (keepinvariant(g))
+    if (keepinvariantgen(g))
     {
-        // reset sweep marks to sweep all elements (returning them to white)
+        // reset sweep marks to sweep all elements (returning them to white, old ones included)
         g->sweepgcopage = g->allgcopages;
+        g->gcsticky = false;
         // reset other collector lists
         g->gray = NULL;
         g->grayagain = NULL;
@@ -1191,6 +1267,10 @@ void luaC_fullgc(lua_State* L)
         g->GCthreshold = g->totalbytes;
 
     g->gcstats.heapgoalsizebytes = heapgoalsizebytes;
+    g->gcstats.majorendtotalsizebytes = g->totalbytes;
+
+    if (g->sweeper)
+        luaM_flushsweeper(L);
 
 #ifdef LUAI_GCMETRICS
     finishGcCycleMetrics(g);
@@ -1201,9 +1281,9 @@ void luaC_barrierf(lua_State* L, GCObject* o, GCObject* v)
 {
     global_State* g = L->global;
     LUAU_ASSERT(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-    LUAU_ASSERT(g->gcstate != GCSpause);
+    LUAU_ASSERT(g->gcstate != GCSpause || g->gcsticky);
     // must keep invariant?
-    if (keepinvariant(g))
+    if (keepinvariantgen(g))
         reallymarkobject(g, v); // restore invariant
     else                        // don't mind
         makewhite(g, o);        // mark as white just to avoid other barriers
@@ -1223,7 +1303,7 @@ void luaC_barriertable(lua_State* L, LuaTable* t, GCObject* v)
     }
 
     LUAU_ASSERT(isblack(o) && !isdead(g, o));
-    LUAU_ASSERT(g->gcstate != GCSpause);
+    LUAU_ASSERT(g->gcstate != GCSpause || g->gcsticky);
     black2gray(o); // make table gray (again)
     t->gclist = g->grayagain;
     g->grayagain = o;
@@ -1233,7 +1313,7 @@ void luaC_barrierback(lua_State* L, GCObject* o, GCObject** gclist)
 {
     global_State* g = L->global;
     LUAU_ASSERT(isblack(o) && !isdead(g, o));
-    LUAU_ASSERT(g->gcstate != GCSpause);
+    LUAU_ASSERT(g->gcstate != GCSpause || g->gcsticky);
 
     black2gray(o); // make object gray (again)
     *gclist = g->grayagain;
@@ -1249,7 +1329,7 @@ void luaC_upvalclosed(lua_State* L, UpVal* uv)
 
     if (isgray(o))
     {
-        if (keepinvariant(g))
+        if (keepinvariantgen(g))
         {
             gray2black(o); // closed upvalues need barrier
             luaC_barrier(L, uv, uv->v);
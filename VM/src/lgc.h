@@ -13,6 +13,9 @@
 #define LUAI_GCSTEPMUL 200 // GC runs 'twice the speed' of memory allocation
 #define LUAI_GCSTEPSIZE 1  // GC runs every KB of memory allocation
 
+// in generational mode, a major cycle runs once the heap left behind by minor cycles grows 100% past the last major cycle
+#define LUAI_GCMAJORMUL 100
+
 /*
 ** Possible states of the Garbage Collector
 */
@@ -30,6 +33,14 @@
 */
 #define keepinvariant(g) ((g)->gcstate == GCSpropagate || (g)->gcstate == GCSpropagateagain || (g)->gcstate == GCSatomic)
 
+/*
+** In generational mode, a cycle can end with a sweep that leaves the marks
+** of surviving objects in place. These objects are old and the next (minor)
+** cycle does not traverse them again, so the invariant is also enforced
+** during such a sweep and until the next cycle starts.
+*/
+#define keepinvariantgen(g) (keepinvariant(g) || (g)->gcsticky)
+
 /*
 ** some useful bit tricks
 */
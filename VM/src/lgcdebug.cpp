@@ -18,9 +18,9 @@ static void validateobjref(global_State* g, GCObject* f, GCObject* t)
 {
     LUAU_ASSERT(!isdead(g, t));
 
-    if (keepinvariant(g))
+    if (keepinvariantgen(g))
     {
-        // basic incremental invariant: black can't point to white
+        // basic incremental invariant: black can't point to white (also between cycles when old objects keep their marks)
         LUAU_ASSERT(!(isblack(f) && iswhite(t)));
     }
 }
@@ -185,7 +185,7 @@ static void validateobj(global_State* g, GCObject* o)
 
 static void validategraylist(global_State* g, GCObject* o)
 {
-    if (!keepinvariant(g))
+    if (!keepinvariantgen(g))
         return;
 
     while (o)
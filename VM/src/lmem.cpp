@@ -8,6 +8,19 @@
 
 #include <string.h>
 
+// the background sweeper needs threads, which the wasm builds don't have
+#if !defined(__EMSCRIPTEN__) && !defined(__wasm__)
+#define LUAI_BACKGROUNDSWEEP
+#endif
+
+#ifdef LUAI_BACKGROUNDSWEEP
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#endif
+
 /*
  * Luau heap uses a size-segregated page structure, with individual pages and large allocations
  * allocated using system heap (via frealloc callback).
@@ -80,6 +93,15 @@
  * the contents of the page, and the free list for further reuse; this allows shorter page setup times
  * which results in less variance between allocation cost, as well as tighter sweep bounds for newly
  * allocated pages.
+ *
+ * Native builds can opt into a background sweeper (lua_gc with LUA_GCSETBACKGROUNDSWEEP). With it, pages that become
+ * empty (mostly pages whose last object was freed by the GC sweep) and large blocks aren't returned to frealloc on the
+ * spot. They are collected on a list that every GC step publishes, through a lock-free list, to a helper thread. The
+ * helper keeps some memory of the two standard page sizes for reuse and hands it back through per-size lock-free lists
+ * that newpage takes from before calling frealloc; everything else goes back to frealloc on the helper thread.
+ * Objects, their marks and the per-page free lists stay with the mutator: the sweep still has to whiten survivors and
+ * unlink dead strings while write barriers keep changing marks, so only memory nothing can reach anymore crosses
+ * threads. This requires frealloc to be safe to call from another thread.
  */
 
 #ifndef __has_feature
@@ -237,13 +259,287 @@ l_noret luaM_toobig(lua_State* L)
     luaG_runerror(L, "memory allocation error: block too big");
 }
 
+#ifdef LUAI_BACKGROUNDSWEEP
+// released memory waiting for the helper thread, the header is written over the start of the page or block
+struct ReleasedBlock
+{
+    ReleasedBlock* next;
+    size_t size;
+};
+
+// upper bound on the memory the helper keeps around for reuse, the rest goes back to frealloc
+const size_t kSweeperCacheSize = 1024 * 1024;
+
+// released memory is published at the end of each GC step, or earlier once this much is waiting (GC steps may be stopped)
+const size_t kSweeperFlushSize = 256 * 1024;
+
+struct lua_Sweeper
+{
+    lua_Alloc frealloc;
+    void* ud;
+
+    std::atomic<ReleasedBlock*> released; // flushed by the mutator, taken all at once by the helper
+    std::atomic<lua_Page*> ready[2];      // small and large pages for reuse, pushed by the helper, taken all at once by the mutator
+    std::atomic<size_t> readybytes;
+
+    ReleasedBlock* pending; // released since the last flush, only touched by the mutator
+    ReleasedBlock* pendingtail;
+    size_t pendingbytes;
+
+    lua_Page* cached[2]; // pages the mutator took from ready but didn't use yet
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stop; // protected by mutex
+
+    std::thread thread;
+};
+
+static int sweeperpagekind(size_t size)
+{
+    return size == kSmallPageSize ? 0 : size == kLargePageSize ? 1 : -1;
+}
+
+static void sweeperreclaim(lua_Sweeper* s, ReleasedBlock* block)
+{
+    size_t size = block->size;
+    int kind = sweeperpagekind(size);
+
+    // memory of a standard page size can become any page of that size, newpage sets up the header and poisons the data
+    if (kind >= 0 && s->readybytes.load(std::memory_order_relaxed) + size <= kSweeperCacheSize)
+    {
+        lua_Page* page = (lua_Page*)block;
+        s->readybytes.fetch_add(size, std::memory_order_relaxed);
+
+        page->next = s->ready[kind].load(std::memory_order_relaxed);
+        while (!s->ready[kind].compare_exchange_weak(page->next, page, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+    else
+    {
+        s->frealloc(s->ud, block, size, 0);
+    }
+}
+
+static void sweeperloop(lua_Sweeper* s)
+{
+    for (;;)
+    {
+        ReleasedBlock* block = s->released.exchange(NULL, std::memory_order_acquire);
+
+        if (!block)
+        {
+            std::unique_lock<std::mutex> lock(s->mutex);
+
+            while (!s->stop && !s->released.load(std::memory_order_relaxed))
+                s->wakeup.wait(lock);
+
+            // everything released before the stop request is reclaimed before the thread exits
+            if (s->stop && !s->released.load(std::memory_order_relaxed))
+                break;
+
+            continue;
+        }
+
+        while (block)
+        {
+            ReleasedBlock* next = block->next;
+            sweeperreclaim(s, block);
+            block = next;
+        }
+    }
+}
+
+static void sweeperflush(lua_Sweeper* s)
+{
+    ReleasedBlock* first = s->pending;
+    ReleasedBlock* last = s->pendingtail;
+
+    if (!first)
+        return;
+
+    s->pending = NULL;
+    s->pendingtail = NULL;
+    s->pendingbytes = 0;
+
+    // once the blocks are published the helper may reclaim them at any time, so the previous head is kept on the side
+    ReleasedBlock* head = s->released.load(std::memory_order_relaxed);
+
+    do
+        last->next = head;
+    while (!s->released.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+
+    // the helper only waits when the list is empty, so only the first batch it hasn't seen yet needs to wake it up
+    if (!head)
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->wakeup.notify_one();
+    }
+}
+
+static void sweeperrelease(lua_Sweeper* s, void* ptr, size_t size)
+{
+    ReleasedBlock* block = (ReleasedBlock*)ptr;
+    block->size = size;
+    block->next = s->pending;
+
+    if (!s->pending)
+        s->pendingtail = block;
+
+    s->pending = block;
+    s->pendingbytes += size;
+
+    if (s->pendingbytes >= kSweeperFlushSize)
+        sweeperflush(s);
+}
+
+static lua_Page* sweepertake(lua_Sweeper* s, size_t size)
+{
+    int kind = sweeperpagekind(size);
+    if (kind < 0)
+        return NULL;
+
+    lua_Page* page = s->cached[kind];
+
+    if (!page)
+        page = s->ready[kind].exchange(NULL, std::memory_order_acquire);
+
+    if (!page)
+        return NULL;
+
+    s->cached[kind] = page->next;
+    s->readybytes.fetch_sub(size, std::memory_order_relaxed);
+
+    return page;
+}
+#endif
+
+// returns a page or a large block to frealloc, or to the background sweeper when there is one
+static void freeraw(global_State* g, void* block, size_t size)
+{
+#ifdef LUAI_BACKGROUNDSWEEP
+    // empty allocations have no block to hand over
+    if (g->sweeper && block)
+    {
+        sweeperrelease(g->sweeper, block, size);
+        return;
+    }
+#endif
+
+    (*g->frealloc)(g->ud, block, size, 0);
+}
+
+bool luaM_startsweeper(lua_State* L)
+{
+#ifdef LUAI_BACKGROUNDSWEEP
+    global_State* g = L->global;
+
+    if (g->sweeper)
+        return true;
+
+    void* mem = (*g->frealloc)(g->ud, NULL, 0, sizeof(lua_Sweeper));
+    if (!mem)
+        return false;
+
+    lua_Sweeper* s = new (mem) lua_Sweeper();
+    s->frealloc = g->frealloc;
+    s->ud = g->ud;
+    s->released.store(NULL, std::memory_order_relaxed);
+    s->pending = NULL;
+    s->pendingtail = NULL;
+    s->pendingbytes = 0;
+    s->ready[0].store(NULL, std::memory_order_relaxed);
+    s->ready[1].store(NULL, std::memory_order_relaxed);
+    s->readybytes.store(0, std::memory_order_relaxed);
+    s->cached[0] = NULL;
+    s->cached[1] = NULL;
+    s->stop = false;
+
+    try
+    {
+        s->thread = std::thread(sweeperloop, s);
+    }
+    catch (...)
+    {
+        s->~lua_Sweeper();
+        (*g->frealloc)(g->ud, s, sizeof(lua_Sweeper), 0);
+        return false;
+    }
+
+    g->sweeper = s;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void luaM_stopsweeper(lua_State* L)
+{
+#ifdef LUAI_BACKGROUNDSWEEP
+    global_State* g = L->global;
+    lua_Sweeper* s = g->sweeper;
+
+    if (!s)
+        return;
+
+    sweeperflush(s);
+
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->stop = true;
+    }
+
+    s->wakeup.notify_one();
+    s->thread.join();
+
+    // the helper has reclaimed everything released so far, what's left is the memory it kept for reuse
+    for (int kind = 0; kind < 2; ++kind)
+    {
+        size_t size = kind == 0 ? kSmallPageSize : kLargePageSize;
+
+        lua_Page* lists[] = {s->cached[kind], s->ready[kind].load(std::memory_order_acquire)};
+
+        for (lua_Page* page : lists)
+        {
+            while (page)
+            {
+                lua_Page* next = page->next;
+                (*g->frealloc)(g->ud, page, size, 0);
+                page = next;
+            }
+        }
+    }
+
+    g->sweeper = NULL;
+
+    s->~lua_Sweeper();
+    (*g->frealloc)(g->ud, s, sizeof(lua_Sweeper), 0);
+#endif
+}
+
+void luaM_flushsweeper(lua_State* L)
+{
+#ifdef LUAI_BACKGROUNDSWEEP
+    if (lua_Sweeper* s = L->global->sweeper)
+        sweeperflush(s);
+#endif
+}
+
 static lua_Page* newpage(lua_State* L, lua_Page** pageset, int pageSize, int blockSize, int blockCount)
 {
     global_State* g = L->global;
 
     LUAU_ASSERT(pageSize - int(offsetof(lua_Page, data)) >= blockSize * blockCount);
 
-    lua_Page* page = (lua_Page*)(*g->frealloc)(g->ud, NULL, 0, pageSize);
+    lua_Page* page = NULL;
+
+#ifdef LUAI_BACKGROUNDSWEEP
+    if (g->sweeper)
+        page = sweepertake(g->sweeper, pageSize);
+#endif
+
+    if (!page)
+        page = (lua_Page*)(*g->frealloc)(g->ud, NULL, 0, pageSize);
     if (!page)
         luaD_throw(L, LUA_ERRMEM);
 
@@ -313,7 +609,7 @@ static void freepage(lua_State* L, lua_Page** pageset, lua_Page* page)
     }
 
     // so long
-    (*g->frealloc)(g->ud, page, page->pageSize, 0);
+    freeraw(g, page, page->pageSize);
 }
 
 static void freeclasspage(lua_State* L, lua_Page** freepageset, lua_Page** pageset, lua_Page* page, uint8_t sizeClass)
@@ -565,7 +861,7 @@ void luaM_free_(lua_State* L, void* block, size_t osize, uint8_t memcat)
     if (oclass >= 0)
         freeblock(L, oclass, block);
     else
-        (*g->frealloc)(g->ud, block, osize, 0);
+        freeraw(g, block, osize);
 
     g->totalbytes -= osize;
     g->memcatbytes[memcat] -= osize;
@@ -619,12 +915,17 @@ void* luaM_realloc_(lua_State* L, void* block, size_t osize, size_t nsize, uint8
         if (oclass >= 0)
             freeblock(L, oclass, block);
         else
-            (*g->frealloc)(g->ud, block, osize, 0);
+            freeraw(g, block, osize);
+    }
+    else if (nsize == 0)
+    {
+        freeraw(g, block, osize);
+        result = NULL;
     }
     else
     {
         result = (*g->frealloc)(g->ud, block, osize, nsize);
-        if (result == NULL && nsize > 0)
+        if (result == NULL)
             luaD_throw(L, LUA_ERRMEM);
     }
 
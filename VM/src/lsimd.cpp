@@ -0,0 +1,336 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+#include "lsimd.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LUAI_SIMD_SSE2
+#include <emmintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <immintrin.h>
+#include <intrin.h>
+#define LUAI_TARGET_AVX2
+#elif defined(__GNUC__) && defined(__has_attribute)
+#if __has_attribute(target)
+#include <immintrin.h>
+#define LUAI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#elif defined(__wasm_simd128__)
+#define LUAI_SIMD_WASM
+#include <wasm_simd128.h>
+#endif
+
+static int lowestbit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long r;
+    _BitScanForward(&r, mask);
+    return int(r);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// scalar versions, also used for the tails the vector loops leave behind
+
+static const char* memfind_scalar(const char* s, size_t l, const char* p, size_t lp)
+{
+    if (lp > l)
+        return NULL; // avoids a negative `l'
+
+    const char* init; // to search for a `*p' inside `s'
+    lp--;             // 1st char will be checked by `memchr'
+    l = l - lp;       // `p' cannot be found after that
+    while (l > 0 && (init = (const char*)memchr(s, *p, l)) != NULL)
+    {
+        init++; // 1st char is already checked
+        if (memcmp(init, p + 1, lp) == 0)
+            return init - 1;
+        else
+        { // correct `l' and `s' to try again
+            l -= init - s;
+            s = init;
+        }
+    }
+    return NULL; // not found
+}
+
+// checks the block candidates, a set bit in mask means the first and the last byte of p matched at that offset
+static const char* memfind_candidates(const char* s, unsigned mask, const char* p, size_t lp)
+{
+    while (mask)
+    {
+        int i = lowestbit(mask);
+        if (memcmp(s + i + 1, p + 1, lp - 2) == 0)
+            return s + i;
+        mask &= mask - 1;
+    }
+    return NULL;
+}
+
+static bool memhasany_scalar(const char* s, size_t l, const char* set, size_t n)
+{
+    for (size_t i = 0; i < l; i++)
+        if (memchr(set, s[i], n))
+            return true;
+    return false;
+}
+
+// flips the case bit of the bytes in [first, first + 26)
+static void memcase_scalar(char* d, const char* s, size_t l, char first)
+{
+    for (size_t i = 0; i < l; i++)
+        d[i] = (unsigned char)(s[i] - first) < 26 ? char(s[i] ^ 0x20) : s[i];
+}
+
+#ifdef LUAI_SIMD_SSE2
+// the block loops look for the first and the last byte of p at once and only compare the middle on candidates
+static const char* memfind_sse2(const char* s, size_t l, const char* p, size_t lp)
+{
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[lp - 1]);
+
+    size_t i = 0;
+    for (; i + lp - 1 + 16 <= l; i += 16)
+    {
+        __m128i f = _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i*)(s + i)));
+        __m128i e = _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i*)(s + i + lp - 1)));
+
+        if (const char* res = memfind_candidates(s + i, unsigned(_mm_movemask_epi8(_mm_and_si128(f, e))), p, lp))
+            return res;
+    }
+
+    return memfind_scalar(s + i, l - i, p, lp);
+}
+
+static bool memhasany_sse2(const char* s, size_t l, const char* set, size_t n)
+{
+    __m128i chars[16];
+    for (size_t k = 0; k < n; k++)
+        chars[k] = _mm_set1_epi8(set[k]);
+
+    size_t i = 0;
+    for (; i + 16 <= l; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i hit = _mm_setzero_si128();
+        for (size_t k = 0; k < n; k++)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, chars[k]));
+
+        if (_mm_movemask_epi8(hit))
+            return true;
+    }
+
+    return memhasany_scalar(s + i, l - i, set, n);
+}
+
+static void memcase_sse2(char* d, const char* s, size_t l, char first)
+{
+    // SSE2 only has signed compares, so the range check is shifted to start at -128
+    const __m128i bias = _mm_set1_epi8(char(-128 - first));
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    const __m128i bit = _mm_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 16 <= l; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i inrange = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+        _mm_storeu_si128((__m128i*)(d + i), _mm_xor_si128(v, _mm_and_si128(inrange, bit)));
+    }
+
+    memcase_scalar(d + i, s + i, l - i, first);
+}
+#endif
+
+#ifdef LUAI_TARGET_AVX2
+LUAI_TARGET_AVX2 static const char* memfind_avx2(const char* s, size_t l, const char* p, size_t lp)
+{
+    const __m256i first = _mm256_set1_epi8(p[0]);
+    const __m256i last = _mm256_set1_epi8(p[lp - 1]);
+
+    size_t i = 0;
+    for (; i + lp - 1 + 32 <= l; i += 32)
+    {
+        __m256i f = _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i*)(s + i)));
+        __m256i e = _mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i*)(s + i + lp - 1)));
+
+        if (const char* res = memfind_candidates(s + i, unsigned(_mm256_movemask_epi8(_mm256_and_si256(f, e))), p, lp))
+            return res;
+    }
+
+    return memfind_sse2(s + i, l - i, p, lp);
+}
+
+LUAI_TARGET_AVX2 static bool memhasany_avx2(const char* s, size_t l, const char* set, size_t n)
+{
+    __m256i chars[16];
+    for (size_t k = 0; k < n; k++)
+        chars[k] = _mm256_set1_epi8(set[k]);
+
+    size_t i = 0;
+    for (; i + 32 <= l; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i hit = _mm256_setzero_si256();
+        for (size_t k = 0; k < n; k++)
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, chars[k]));
+
+        if (_mm256_movemask_epi8(hit))
+            return true;
+    }
+
+    return memhasany_sse2(s + i, l - i, set, n);
+}
+
+LUAI_TARGET_AVX2 static void memcase_avx2(char* d, const char* s, size_t l, char first)
+{
+    const __m256i bias = _mm256_set1_epi8(char(-128 - first));
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 32 <= l; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i inrange = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, bias));
+        _mm256_storeu_si256((__m256i*)(d + i), _mm256_xor_si256(v, _mm256_and_si256(inrange, bit)));
+    }
+
+    memcase_sse2(d + i, s + i, l - i, first);
+}
+
+static bool luai_hasavx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int cpuinfo[4] = {};
+    __cpuid(cpuinfo, 1);
+
+    // AVX2 needs the OS to save YMM registers (OSXSAVE and XCR0 bits 1-2) on top of the feature bit itself
+    // https://en.wikipedia.org/wiki/CPUID#EAX=7,_ECX=0:_Extended_Features
+    if ((cpuinfo[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(cpuinfo, 7, 0);
+    return (cpuinfo[1] & (1 << 5)) != 0;
+#else
+    // this runs from a static initializer, before the cpu model is guaranteed to be initialized
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef LUAI_SIMD_WASM
+static const char* memfind_wasm(const char* s, size_t l, const char* p, size_t lp)
+{
+    const v128_t first = wasm_i8x16_splat(p[0]);
+    const v128_t last = wasm_i8x16_splat(p[lp - 1]);
+
+    size_t i = 0;
+    for (; i + lp - 1 + 16 <= l; i += 16)
+    {
+        v128_t f = wasm_i8x16_eq(first, wasm_v128_load(s + i));
+        v128_t e = wasm_i8x16_eq(last, wasm_v128_load(s + i + lp - 1));
+
+        if (const char* res = memfind_candidates(s + i, wasm_i8x16_bitmask(wasm_v128_and(f, e)), p, lp))
+            return res;
+    }
+
+    return memfind_scalar(s + i, l - i, p, lp);
+}
+
+static bool memhasany_wasm(const char* s, size_t l, const char* set, size_t n)
+{
+    v128_t chars[16];
+    for (size_t k = 0; k < n; k++)
+        chars[k] = wasm_i8x16_splat(set[k]);
+
+    size_t i = 0;
+    for (; i + 16 <= l; i += 16)
+    {
+        v128_t v = wasm_v128_load(s + i);
+        v128_t hit = wasm_i8x16_splat(0);
+        for (size_t k = 0; k < n; k++)
+            hit = wasm_v128_or(hit, wasm_i8x16_eq(v, chars[k]));
+
+        if (wasm_v128_any_true(hit))
+            return true;
+    }
+
+    return memhasany_scalar(s + i, l - i, set, n);
+}
+
+static void memcase_wasm(char* d, const char* s, size_t l, char first)
+{
+    const v128_t start = wasm_i8x16_splat(first);
+    const v128_t limit = wasm_i8x16_splat(26);
+    const v128_t bit = wasm_i8x16_splat(0x20);
+
+    size_t i = 0;
+    for (; i + 16 <= l; i += 16)
+    {
+        v128_t v = wasm_v128_load(s + i);
+        v128_t inrange = wasm_u8x16_lt(wasm_i8x16_sub(v, start), limit);
+        wasm_v128_store(d + i, wasm_v128_xor(v, wasm_v128_and(inrange, bit)));
+    }
+
+    memcase_scalar(d + i, s + i, l - i, first);
+}
+#endif
+
+struct SimdKernels
+{
+    const char* (*memfind)(const char* s, size_t l, const char* p, size_t lp);
+    bool (*memhasany)(const char* s, size_t l, const char* set, size_t n);
+    void (*memcase)(char* d, const char* s, size_t l, char first);
+};
+
+static SimdKernels luai_simdkernels()
+{
+#if defined(LUAI_TARGET_AVX2)
+    if (luai_hasavx2())
+        return {memfind_avx2, memhasany_avx2, memcase_avx2};
+#endif
+
+#if defined(LUAI_SIMD_SSE2)
+    return {memfind_sse2, memhasany_sse2, memcase_sse2};
+#elif defined(LUAI_SIMD_WASM)
+    return {memfind_wasm, memhasany_wasm, memcase_wasm};
+#else
+    return {memfind_scalar, memhasany_scalar, memcase_scalar};
+#endif
+}
+
+static const SimdKernels kernels = luai_simdkernels();
+
+const char* luaI_memfind(const char* s, size_t l, const char* p, size_t lp)
+{
+    if (lp == 0)
+        return s; // empty strings are everywhere
+    else if (lp > l)
+        return NULL;
+    else if (lp == 1)
+        return (const char*)memchr(s, *p, l);
+    else
+        return kernels.memfind(s, l, p, lp);
+}
+
+bool luaI_memhasany(const char* s, size_t l, const char* set, size_t n)
+{
+    LUAU_ASSERT(n <= 16);
+    return kernels.memhasany(s, l, set, n);
+}
+
+void luaI_memlower(char* d, const char* s, size_t l)
+{
+    kernels.memcase(d, s, l, 'A');
+}
+
+void luaI_memupper(char* d, const char* s, size_t l)
+{
+    kernels.memcase(d, s, l, 'a');
+}
@@ -0,0 +1,20 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+#pragma once
+
+#include "lcommon.h"
+
+#include <stddef.h>
+
+// byte scanning kernels used by the string library
+// x64 builds pick between SSE2 and AVX2 at startup, wasm builds use SIMD128 when compiled with -msimd128, everything else
+// uses the scalar versions
+
+// first occurrence of p[0..lp) in s[0..l), NULL if there is none
+LUAI_FUNC const char* luaI_memfind(const char* s, size_t l, const char* p, size_t lp);
+
+// whether any byte of s[0..l) is one of the n (at most 16) bytes in set
+LUAI_FUNC bool luaI_memhasany(const char* s, size_t l, const char* set, size_t n);
+
+// ASCII case mapping of l bytes from s to d, matching tolower/toupper in the "C" locale
+LUAI_FUNC void luaI_memlower(char* d, const char* s, size_t l);
+LUAI_FUNC void luaI_memupper(char* d, const char* s, size_t l);
@@ -103,6 +103,8 @@ static void close_state(lua_State* L)
     for (int i = 1; i < LUA_MEMORY_CATEGORIES; i++)
         LUAU_ASSERT(g->memcatbytes[i] == 0);
 
+    luaM_stopsweeper(L); // waits for the memory freed above to be reclaimed
+
     if (L->global->ecb.close)
         L->global->ecb.close(L);
 
@@ -194,6 +196,9 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
     setnilvalue(&g->pseudotemp);
     setnilvalue(registry(L));
     g->gcstate = GCSpause;
+    g->gcgen = false;
+    g->gcminor = false;
+    g->gcsticky = false;
     g->gray = NULL;
     g->grayagain = NULL;
     g->weak = NULL;
@@ -209,6 +214,7 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
     g->allpages = NULL;
     g->allgcopages = NULL;
     g->sweepgcopage = NULL;
+    g->sweeper = NULL;
     for (i = 0; i < LUA_T_COUNT; i++)
         g->mt[i] = NULL;
     for (i = 0; i < LUA_UTAG_LIMIT; i++)
@@ -88,11 +88,16 @@ struct GCStats
     double starttimestamp = 0;
     double atomicstarttimestamp = 0;
     double endtimestamp = 0;
+
+    // heap size at the end of the last cycle that marked everything, paces major cycles in generational mode
+    size_t majorendtotalsizebytes = 0;
 };
 
 #ifdef LUAI_GCMETRICS
 struct GCCycleMetrics
 {
+    bool minor = false; // only young objects and the remembered set were marked
+
     size_t starttotalsizebytes = 0;
     size_t heaptriggersizebytes = 0;
 
@@ -142,6 +147,12 @@ struct GCMetrics
 
     GCCycleMetrics lastcycle;
     GCCycleMetrics currcycle;
+
+    // in generational mode, the last cycle of each kind is also kept
+    uint64_t completedminorcycles = 0;
+
+    GCCycleMetrics lastminorcycle;
+    GCCycleMetrics lastmajorcycle;
 };
 #endif
 
@@ -176,6 +187,10 @@ typedef struct global_State
     uint8_t currentwhite;
     uint8_t gcstate; // state of garbage collector
 
+    bool gcgen;    // generational mode, see LUA_GCSETGENERATIONAL
+    bool gcminor;  // current (or last) cycle only marks young objects and the remembered set
+    bool gcsticky; // objects marked by the last atomic phase keep their marks and are old
+
     GCObject* gray;      // list of gray objects
     GCObject* grayagain; // list of objects to be traversed atomically
     GCObject* weak;      // list of weak tables (to be cleared)
@@ -192,6 +207,7 @@ typedef struct global_State
     struct lua_Page* allpages; // page linked list with all pages for all non-collectable object classes (available with LUAU_ASSERTENABLED)
     struct lua_Page* allgcopages; // page linked list with all pages for all collectable object classes
     struct lua_Page* sweepgcopage; // position of the sweep in `allgcopages'
+    struct lua_Sweeper* sweeper; // helper thread that reclaims released pages and large blocks, see lmem.cpp
 
     struct lua_State* mainthread;
     UpVal uvhead; // head of double-linked list of all open upvalues
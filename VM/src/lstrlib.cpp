@@ -2,6 +2,7 @@
 // This code is based on Lua 5.x implementation licensed under MIT License; see lua_LICENSE.txt for details
 #include "lualib.h"
 
+#include "lsimd.h"
 #include "lstring.h"
 
 #include <ctype.h>
@@ -62,8 +63,7 @@ static int str_lower(lua_State* L)
     const char* s = luaL_checklstring(L, 1, &l);
     luaL_Strbuf b;
     char* ptr = luaL_buffinitsize(L, &b, l);
-    for (size_t i = 0; i < l; i++)
-        *ptr++ = tolower(uchar(s[i]));
+    luaI_memlower(ptr, s, l);
     luaL_pushresultsize(&b, l);
     return 1;
 }
@@ -74,8 +74,7 @@ static int str_upper(lua_State* L)
     const char* s = luaL_checklstring(L, 1, &l);
     luaL_Strbuf b;
     char* ptr = luaL_buffinitsize(L, &b, l);
-    for (size_t i = 0; i < l; i++)
-        *ptr++ = toupper(uchar(s[i]));
+    luaI_memupper(ptr, s, l);
     luaL_pushresultsize(&b, l);
     return 1;
 }
@@ -174,12 +173,31 @@ static int str_char(lua_State* L)
 #define CAP_UNFINISHED (-1)
 #define CAP_POSITION (-2)
 
+#define PATTERN_MAXCOMPILE 255 // longer patterns are always interpreted from their text
+#define PATTERN_MAXSETS 255
+#define PATTERN_NOSET 255
+
+// a pattern compiled into annotations for the matcher: for every offset match can step onto a single char class at,
+// where that class ends and the set of chars it matches. offsets that are not annotated (because the text is malformed
+// there, or never reached) are interpreted from the text as usual, so errors are still raised only when reached
+struct PatternProgram
+{
+    uint8_t firstset;  // set every match has to start with, PATTERN_NOSET if unknown
+    uint8_t prefixlen; // length of the literal text every match has to start with
+    char prefix[PATTERN_MAXCOMPILE];
+    uint8_t classlen[PATTERN_MAXCOMPILE]; // classend(p) - p for the class at each offset, 0 if not annotated
+    uint8_t classset[PATTERN_MAXCOMPILE]; // index of the set of chars matched by the class at each offset
+    uint8_t sets[PATTERN_MAXSETS][32];    // only the sets in use are allocated
+};
+
 typedef struct MatchState
 {
     int matchdepth;       // control for recursive depth (to avoid C stack overflow)
     const char* src_init; // init of source string
     const char* src_end;  // end ('\0') of source string
     const char* p_end;    // end ('\0') of pattern
+    const char* p_init;   // init of pattern, before any anchor
+    const PatternProgram* prog; // compiled pattern or NULL, indexed by offsets from p_init
     lua_State* L;
     int level; // total number of captures (finished or unfinished)
     struct
@@ -212,14 +230,28 @@ static int capture_to_close(MatchState* ms)
     luaL_error(ms->L, "invalid pattern capture");
 }
 
-static const char* classend(MatchState* ms, const char* p)
+static const uint8_t* patternset(MatchState* ms, const char* p)
+{
+    const PatternProgram* prog = ms->prog;
+    if (prog && prog->classlen[p - ms->p_init])
+        return prog->sets[prog->classset[p - ms->p_init]];
+    return NULL;
+}
+
+static int testset(const uint8_t* set, int c)
+{
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+// end of the single char class at p, NULL if the class is malformed
+static const char* scanclassend(const char* p, const char* p_end)
 {
     switch (*p++)
     {
     case L_ESC:
     {
-        if (p == ms->p_end)
-            luaL_error(ms->L, "malformed pattern (ends with '%%')");
+        if (p == p_end)
+            return NULL;
         return p + 1;
     }
     case '[':
@@ -228,9 +260,9 @@ static const char* classend(MatchState* ms, const char* p)
             p++;
         do
         { // look for a `]'
-            if (p == ms->p_end)
-                luaL_error(ms->L, "malformed pattern (missing ']')");
-            if (*(p++) == L_ESC && p < ms->p_end)
+            if (p == p_end)
+                return NULL;
+            if (*(p++) == L_ESC && p < p_end)
                 p++; // skip escapes (e.g. `%]')
         } while (*p != ']');
         return p + 1;
@@ -242,6 +274,22 @@ static const char* classend(MatchState* ms, const char* p)
     }
 }
 
+static const char* classend(MatchState* ms, const char* p)
+{
+    if (ms->prog && ms->prog->classlen[p - ms->p_init])
+        return p + ms->prog->classlen[p - ms->p_init];
+
+    const char* ep = scanclassend(p, ms->p_end);
+    if (!ep)
+    {
+        if (*p == L_ESC)
+            luaL_error(ms->L, "malformed pattern (ends with '%%')");
+        else
+            luaL_error(ms->L, "malformed pattern (missing ']')");
+    }
+    return ep;
+}
+
 static int match_class(int c, int cl)
 {
     int res;
@@ -314,25 +362,29 @@ static int matchbracketclass(int c, const char* p, const char* ec)
     return !sig;
 }
 
+static int matchsingleclass(int c, const char* p, const char* ep)
+{
+    switch (*p)
+    {
+    case '.':
+        return 1; // matches any char
+    case L_ESC:
+        return match_class(c, uchar(*(p + 1)));
+    case '[':
+        return matchbracketclass(c, p, ep - 1);
+    default:
+        return (uchar(*p) == c);
+    }
+}
+
 static int singlematch(MatchState* ms, const char* s, const char* p, const char* ep)
 {
     if (s >= ms->src_end)
         return 0;
+    else if (const uint8_t* set = patternset(ms, p))
+        return testset(set, uchar(*s));
     else
-    {
-        int c = uchar(*s);
-        switch (*p)
-        {
-        case '.':
-            return 1; // matches any char
-        case L_ESC:
-            return match_class(c, uchar(*(p + 1)));
-        case '[':
-            return matchbracketclass(c, p, ep - 1);
-        default:
-            return (uchar(*p) == c);
-        }
-    }
+        return matchsingleclass(uchar(*s), p, ep);
 }
 
 static const char* matchbalance(MatchState* ms, const char* s, const char* p)
@@ -363,8 +415,17 @@ static const char* matchbalance(MatchState* ms, const char* s, const char* p)
 static const char* max_expand(MatchState* ms, const char* s, const char* p, const char* ep)
 {
     ptrdiff_t i = 0; // counts maximum expand for item
-    while (singlematch(ms, s + i, p, ep))
-        i++;
+    if (const uint8_t* set = patternset(ms, p))
+    {
+        ptrdiff_t n = ms->src_end - s;
+        while (i < n && testset(set, uchar(s[i])))
+            i++;
+    }
+    else
+    {
+        while (singlematch(ms, s + i, p, ep))
+            i++;
+    }
     // keeps trying to match with the maximum repetitions
     while (i >= 0)
     {
@@ -489,7 +550,15 @@ init: // using goto's to optimize tail recursion
                     luaL_error(ms->L, "missing '[' after '%%f' in pattern");
                 ep = classend(ms, p); // points to what is next
                 previous = (s == ms->src_init) ? '\0' : *(s - 1);
-                if (!matchbracketclass(uchar(previous), p, ep - 1) && matchbracketclass(uchar(*s), p, ep - 1))
+                if (const uint8_t* set = patternset(ms, p))
+                {
+                    if (!testset(set, uchar(previous)) && testset(set, uchar(*s)))
+                    {
+                        p = ep;
+                        goto init; // return match(ms, s, ep);
+                    }
+                }
+                else if (!matchbracketclass(uchar(previous), p, ep - 1) && matchbracketclass(uchar(*s), p, ep - 1))
                 {
                     p = ep;
                     goto init; // return match(ms, s, ep);
@@ -575,32 +644,210 @@ init: // using goto's to optimize tail recursion
     return s;
 }
 
-static const char* lmemfind(const char* s1, size_t l1, const char* s2, size_t l2)
+static int compileset(PatternProgram* prog, int* nsets, const char* p, const char* ep)
 {
-    if (l2 == 0)
-        return s1; // empty strings are everywhere
-    else if (l2 > l1)
-        return NULL; // avoids a negative `l1'
-    else
+    uint8_t set[32] = {};
+    for (int c = 0; c < 256; c++)
+        if (matchsingleclass(c, p, ep))
+            set[c >> 3] |= uint8_t(1 << (c & 7));
+
+    for (int i = 0; i < *nsets; i++)
+        if (memcmp(prog->sets[i], set, sizeof(set)) == 0)
+            return i;
+
+    if (*nsets == PATTERN_MAXSETS)
+        return -1;
+
+    memcpy(prog->sets[*nsets], set, sizeof(set));
+    return (*nsets)++;
+}
+
+// steps through the pattern from offset i the way match does, annotating every single char class on the way;
+// stops at the first malformed item so that match still reaches it through the text and raises the error itself
+static void compilefrom(PatternProgram* prog, int* nsets, const char* p, size_t lp, size_t i)
+{
+    const char* p_end = p + lp;
+    while (i < lp)
     {
-        const char* init; // to search for a `*s2' inside `s1'
-        l2--;             // 1st char will be checked by `memchr'
-        l1 = l1 - l2;     // `s2' cannot be found after that
-        while (l1 > 0 && (init = (const char*)memchr(s1, *s2, l1)) != NULL)
+        const char* item = p + i;
+        const char* ep;
+        switch (*item)
         {
-            init++; // 1st char is already checked
-            if (memcmp(init, s2 + 1, l2) == 0)
-                return init - 1;
-            else
-            { // correct `l1' and `s1' to try again
-                l1 -= init - s1;
-                s1 = init;
+        case '(':
+            i += (*(item + 1) == ')') ? 2 : 1;
+            continue;
+        case ')':
+            i++;
+            continue;
+        case '$':
+            if (i + 1 == lp)
+                return;
+            break;
+        case L_ESC:
+            if (*(item + 1) == 'b')
+            {
+                if (i + 3 >= lp)
+                    return; // missing arguments
+                i += 4;
+                continue;
+            }
+            else if (*(item + 1) == 'f')
+            {
+                item += 2;
+                if (*item != '[' || (ep = scanclassend(item, p_end)) == NULL)
+                    return;
+                int set = compileset(prog, nsets, item, ep);
+                if (set < 0)
+                    return;
+                prog->classlen[item - p] = uint8_t(ep - item);
+                prog->classset[item - p] = uint8_t(set);
+                i = ep - p;
+                continue;
+            }
+            else if (*(item + 1) >= '0' && *(item + 1) <= '9')
+            {
+                i += 2;
+                continue;
             }
+            break;
         }
-        return NULL; // not found
+
+        // single char class plus optional suffix
+        if ((ep = scanclassend(item, p_end)) == NULL)
+            return;
+        int set = compileset(prog, nsets, item, ep);
+        if (set < 0)
+            return;
+        prog->classlen[i] = uint8_t(ep - item);
+        prog->classset[i] = uint8_t(set);
+        i = ep - p;
+        if (i < lp && (p[i] == '*' || p[i] == '+' || p[i] == '-' || p[i] == '?'))
+            i++;
     }
 }
 
+// finds what every match of an unanchored pattern has to start with; only captures being opened are skipped, since
+// everything else in front of the first class could raise an error that skipping ahead would hide
+static void compilestart(PatternProgram* prog, const char* p, size_t lp)
+{
+    prog->firstset = PATTERN_NOSET;
+    prog->prefixlen = 0;
+
+    size_t i = 0;
+    int level = 0;
+    for (;;)
+    {
+        while (i < lp && p[i] == '(' && level < LUA_MAXCAPTURES)
+        {
+            i += (p[i + 1] == ')') ? 2 : 1;
+            level++;
+        }
+        if (i >= lp || p[i] == '(')
+            return;
+
+        if (p[i] == L_ESC && p[i + 1] == 'b')
+        {
+            // a balanced match starts with its opening char
+            if (i + 3 < lp)
+                prog->prefix[prog->prefixlen++] = p[i + 2];
+            return;
+        }
+
+        uint8_t len = prog->classlen[i];
+        if (len == 0)
+            return;
+
+        size_t ep = i + len;
+        char suffix = ep < lp ? p[ep] : '\0';
+        bool optional = suffix == '*' || suffix == '-' || suffix == '?';
+        const uint8_t* set = prog->sets[prog->classset[i]];
+
+        // a class that matches a single char is a literal
+        int literal = -1;
+        for (int c = 0; c < 256; c++)
+        {
+            if (testset(set, c))
+            {
+                if (literal >= 0)
+                {
+                    literal = -1;
+                    break;
+                }
+                literal = c;
+            }
+        }
+
+        if (literal >= 0 && !optional)
+        {
+            prog->prefix[prog->prefixlen++] = char(literal);
+            if (suffix == '+')
+                return;
+            i = ep;
+            continue;
+        }
+
+        if (prog->prefixlen == 0 && !optional)
+            prog->firstset = prog->classset[i];
+        return;
+    }
+}
+
+// pushes the compiled program for the pattern argument (or nil if it is too long to compile) and returns it; programs
+// are cached in the weak table shared by the pattern functions, keeping the result on the stack keeps it alive
+static const PatternProgram* pushprogram(lua_State* L, int arg, const char* p, size_t lp)
+{
+    if (lp > PATTERN_MAXCOMPILE)
+    {
+        lua_pushnil(L);
+        return NULL;
+    }
+
+    lua_pushvalue(L, arg);
+    lua_rawget(L, lua_upvalueindex(1));
+    if (lua_isbuffer(L, -1))
+        return (const PatternProgram*)lua_tobuffer(L, -1, NULL);
+    lua_pop(L, 1);
+
+    PatternProgram prog;
+    int nsets = 0;
+    memset(prog.classlen, 0, sizeof(prog.classlen));
+
+    compilefrom(&prog, &nsets, p, lp, 0);
+    if (*p == '^')
+        compilefrom(&prog, &nsets, p, lp, 1); // find and gsub treat it as an anchor, gmatch as a literal
+    compilestart(&prog, p, lp);
+
+    size_t size = offsetof(PatternProgram, sets) + nsets * sizeof(prog.sets[0]);
+    void* data = lua_newbuffer(L, size);
+    memcpy(data, &prog, size);
+
+    lua_pushvalue(L, arg);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, lua_upvalueindex(1));
+    return (const PatternProgram*)data;
+}
+
+// first position at or after s where a match can start, NULL if there is none
+static const char* skipahead(MatchState* ms, const char* s)
+{
+    const PatternProgram* prog = ms->prog;
+    if (!prog)
+        return s;
+
+    if (prog->prefixlen)
+        return luaI_memfind(s, ms->src_end - s, prog->prefix, prog->prefixlen);
+
+    if (prog->firstset != PATTERN_NOSET)
+    {
+        const uint8_t* set = prog->sets[prog->firstset];
+        while (s < ms->src_end && !testset(set, uchar(*s)))
+            s++;
+        return s < ms->src_end ? s : NULL;
+    }
+
+    return s;
+}
+
 static void push_onecapture(MatchState* ms, int i, const char* s, const char* e)
 {
     if (i >= ms->level)
@@ -635,23 +882,18 @@ static int push_captures(MatchState* ms, const char* s, const char* e)
 // check whether pattern has no special characters
 static int nospecials(const char* p, size_t l)
 {
-    size_t upto = 0;
-    do
-    {
-        if (strpbrk(p + upto, SPECIALS))
-            return 0;                 // pattern has a special character
-        upto += strlen(p + upto) + 1; // may have more after \0
-    } while (upto <= l);
-    return 1; // no special chars found
+    return !luaI_memhasany(p, l, SPECIALS, sizeof(SPECIALS) - 1);
 }
 
-static void prepstate(MatchState* ms, lua_State* L, const char* s, size_t ls, const char* p, size_t lp)
+static void prepstate(MatchState* ms, lua_State* L, const char* s, size_t ls, const char* p, size_t lp, const PatternProgram* prog)
 {
     ms->L = L;
     ms->matchdepth = LUAI_MAXCCALLS;
     ms->src_init = s;
     ms->src_end = s + ls;
     ms->p_end = p + lp;
+    ms->p_init = p;
+    ms->prog = prog;
 }
 
 static void reprepstate(MatchState* ms)
@@ -677,7 +919,7 @@ static int str_find_aux(lua_State* L, int find)
     if (find && (lua_toboolean(L, 4) || nospecials(p, lp)))
     {
         // do a plain search
-        const char* s2 = lmemfind(s + init - 1, ls - init + 1, p, lp);
+        const char* s2 = luaI_memfind(s + init - 1, ls - init + 1, p, lp);
         if (s2)
         {
             lua_pushinteger(L, (int)(s2 - s + 1));
@@ -690,15 +932,14 @@ static int str_find_aux(lua_State* L, int find)
         MatchState ms;
         const char* s1 = s + init - 1;
         int anchor = (*p == '^');
+        prepstate(&ms, L, s, ls, p, lp, pushprogram(L, 2, p, lp));
         if (anchor)
-        {
-            p++;
-            lp--; // skip anchor character
-        }
-        prepstate(&ms, L, s, ls, p, lp);
+            p++; // skip anchor character
         do
         {
             const char* res;
+            if (!anchor && (s1 = skipahead(&ms, s1)) == NULL)
+                break;
             reprepstate(&ms);
             if ((res = match(&ms, s1, p)) != NULL)
             {
@@ -734,10 +975,12 @@ static int gmatch_aux(lua_State* L)
     const char* s = lua_tolstring(L, lua_upvalueindex(1), &ls);
     const char* p = lua_tolstring(L, lua_upvalueindex(2), &lp);
     const char* src;
-    prepstate(&ms, L, s, ls, p, lp);
+    prepstate(&ms, L, s, ls, p, lp, (const PatternProgram*)lua_tobuffer(L, lua_upvalueindex(4), NULL));
     for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3)); src <= ms.src_end; src++)
     {
         const char* e;
+        if ((src = skipahead(&ms, src)) == NULL)
+            break;
         reprepstate(&ms);
         if ((e = match(&ms, src, p)) != NULL)
         {
@@ -754,11 +997,13 @@ static int gmatch_aux(lua_State* L)
 
 static int gmatch(lua_State* L)
 {
+    size_t lp;
     luaL_checkstring(L, 1);
-    luaL_checkstring(L, 2);
+    const char* p = luaL_checklstring(L, 2, &lp);
     lua_settop(L, 2);
     lua_pushinteger(L, 0);
-    lua_pushcclosure(L, gmatch_aux, NULL, 3);
+    pushprogram(L, 2, p, lp);
+    lua_pushcclosure(L, gmatch_aux, NULL, 4);
     return 1;
 }
 
@@ -840,16 +1085,21 @@ static int str_gsub(lua_State* L)
     MatchState ms;
     luaL_Strbuf b;
     luaL_argexpected(L, tr == LUA_TNUMBER || tr == LUA_TSTRING || tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3, "string/function/table");
+    prepstate(&ms, L, src, srcl, p, lp, pushprogram(L, 2, p, lp));
     luaL_buffinit(L, &b);
     if (anchor)
-    {
-        p++;
-        lp--; // skip anchor character
-    }
-    prepstate(&ms, L, src, srcl, p, lp);
+        p++; // skip anchor character
     while (n < max_s)
     {
         const char* e;
+        if (!anchor)
+        {
+            const char* next = skipahead(&ms, src);
+            if (next == NULL)
+                break;
+            luaL_addlstring(&b, src, next - src); // no match can start before next
+            src = next;
+        }
         reprepstate(&ms);
         e = match(&ms, src, p);
         if (e)
@@ -1083,36 +1333,34 @@ static int str_split(lua_State* L)
     lua_createtable(L, 0, 0);
 
     if (needleLen == 0)
-        begin++;
-
-    // Don't iterate the last needleLen - 1 bytes of the string - they are
-    // impossible to be splits and would let us memcmp past the end of the
-    // buffer.
-    for (const char* iter = begin; iter <= end - needleLen; iter++)
     {
-        // Use of memcmp here instead of strncmp is so that we allow embedded
-        // nulls to be used in either of the haystack or the needle strings.
-        // Most Lua string APIs allow embedded nulls, and this should be no
-        // exception.
-        if (memcmp(iter, needle, needleLen) == 0)
+        // an empty separator splits the string into single characters
+        for (const char* iter = begin + 1; iter <= end; iter++)
         {
             lua_pushinteger(L, ++numMatches);
             lua_pushlstring(L, spanStart, iter - spanStart);
             lua_settable(L, -3);
 
-            spanStart = iter + needleLen;
-            if (needleLen > 0)
-                iter += needleLen - 1;
+            spanStart = iter;
         }
+
+        return 1;
     }
 
-    if (needleLen > 0)
+    // embedded nulls are allowed in either of the haystack or the needle strings, like in most Lua string APIs
+    for (const char* iter = begin; (iter = luaI_memfind(iter, end - iter, needle, needleLen)) != NULL; iter += needleLen)
     {
         lua_pushinteger(L, ++numMatches);
-        lua_pushlstring(L, spanStart, end - spanStart);
+        lua_pushlstring(L, spanStart, iter - spanStart);
         lua_settable(L, -3);
+
+        spanStart = iter + needleLen;
     }
 
+    lua_pushinteger(L, ++numMatches);
+    lua_pushlstring(L, spanStart, end - spanStart);
+    lua_settable(L, -3);
+
     return 1;
 }
 
@@ -1637,13 +1885,9 @@ static int str_unpack(lua_State* L)
 static const luaL_Reg strlib[] = {
     {"byte", str_byte},
     {"char", str_char},
-    {"find", str_find},
     {"format", str_format},
-    {"gmatch", gmatch},
-    {"gsub", str_gsub},
     {"len", str_len},
     {"lower", str_lower},
-    {"match", str_match},
     {"rep", str_rep},
     {"reverse", str_reverse},
     {"sub", str_sub},
@@ -1670,9 +1914,31 @@ static void createmetatable(lua_State* L)
 /*
 ** Open string library
 */
+static const luaL_Reg patternlib[] = {
+    {"find", str_find},
+    {"gmatch", gmatch},
+    {"gsub", str_gsub},
+    {"match", str_match},
+    {NULL, NULL},
+};
+
 int luaopen_string(lua_State* L)
 {
     luaL_register(L, LUA_STRLIBNAME, strlib);
+
+    // pattern functions share a cache of compiled patterns, its values are weak so unused programs are collected
+    lua_createtable(L, 0, 0);
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    for (const luaL_Reg* l = patternlib; l->name; l++)
+    {
+        lua_pushvalue(L, -1);
+        lua_pushcclosure(L, l->func, l->name, 1);
+        lua_setfield(L, -3, l->name);
+    }
+    lua_pop(L, 1);
     createmetatable(L);
 
     return 1;
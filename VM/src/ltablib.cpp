@@ -10,6 +10,9 @@
 #include "lgc.h"
 #include "ldebug.h"
 #include "lvm.h"
+#include "lmem.h"
+
+#include <math.h>
 
 static int foreachi(lua_State* L)
 {
@@ -472,6 +475,236 @@ static void sort_rec(lua_State* L, LuaTable* t, int l, int u, int limit, SortPre
     }
 }
 
+// arrays where every element is a number or every element is a string are sorted without a comparator by copying the
+// elements out as raw doubles or TString pointers and sorting those with a pattern-defeating quicksort
+// equal elements of these arrays are indistinguishable (arrays with NaN or negative zero take the generic path), so
+// the result is the same as the generic sort would produce, and the comparisons can't raise errors or modify the table
+#define SORT_INSERTION_THRESHOLD 24
+#define SORT_NINTHER_THRESHOLD 128
+
+struct SortNumberLess
+{
+    bool operator()(double a, double b) const
+    {
+        return a < b;
+    }
+};
+
+struct SortStringLess
+{
+    bool operator()(TString* a, TString* b) const
+    {
+        return luaV_strcmp(a, b) < 0;
+    }
+};
+
+template<typename T>
+inline void sort_swapkeys(T* a, T* b)
+{
+    T temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+template<typename T, typename Less>
+inline void sort_order3(T* a, T* b, T* c, Less less)
+{
+    if (less(*b, *a))
+        sort_swapkeys(a, b);
+    if (less(*c, *b))
+    {
+        sort_swapkeys(b, c);
+        if (less(*b, *a))
+            sort_swapkeys(a, b);
+    }
+}
+
+template<typename T, typename Less>
+static void sort_insertionkeys(T* begin, T* end, Less less)
+{
+    for (T* i = begin + 1; i < end; ++i)
+    {
+        T v = *i;
+        T* j = i;
+        for (; j > begin && less(v, *(j - 1)); --j)
+            *j = *(j - 1);
+        *j = v;
+    }
+}
+
+template<typename T, typename Less>
+static void sort_siftkeys(T* a, ptrdiff_t count, ptrdiff_t root, Less less)
+{
+    for (;;)
+    {
+        ptrdiff_t next = root * 2 + 1;
+        if (next >= count)
+            break;
+        if (next + 1 < count && less(a[next], a[next + 1]))
+            next++;
+        if (!less(a[root], a[next]))
+            break;
+        sort_swapkeys(&a[root], &a[next]);
+        root = next;
+    }
+}
+
+template<typename T, typename Less>
+static void sort_heapkeys(T* begin, T* end, Less less)
+{
+    ptrdiff_t count = end - begin;
+
+    for (ptrdiff_t i = count / 2 - 1; i >= 0; --i)
+        sort_siftkeys(begin, count, i, less);
+
+    for (ptrdiff_t i = count - 1; i > 0; --i)
+    {
+        sort_swapkeys(&begin[0], &begin[i]);
+        sort_siftkeys(begin, i, 0, less);
+    }
+}
+
+// partitions [begin, end) around the pivot at begin and returns its final position; with equal set, everything equal to
+// the pivot goes to its left as well and the returned position is one past the run of equal elements
+// the loop has no data dependent branches: each element is swapped into place and the boundary advances on a match
+template<typename T, typename Less, bool Equal>
+static T* sort_partitionkeys(T* begin, T* end, Less less)
+{
+    T pivot = *begin;
+    T* boundary = begin + 1;
+    for (T* it = begin + 1; it < end; ++it)
+    {
+        T v = *it;
+        bool left = Equal ? !less(pivot, v) : less(v, pivot);
+        *it = *boundary;
+        *boundary = v;
+        boundary += left;
+    }
+
+    if (Equal)
+        return boundary;
+
+    *begin = *(boundary - 1);
+    *(boundary - 1) = pivot;
+    return boundary - 1;
+}
+
+template<typename T, typename Less>
+static void sort_keys(T* begin, T* end, int limit, bool leftmost, Less less)
+{
+    for (;;)
+    {
+        ptrdiff_t size = end - begin;
+        if (size <= SORT_INSERTION_THRESHOLD)
+            return sort_insertionkeys(begin, end, less);
+
+        // quick sort is going over the permitted nlogn complexity, fall back to heap sort
+        if (limit == 0)
+            return sort_heapkeys(begin, end, less);
+        limit--;
+
+        // move the median of 3 (or of 3 medians of 3 on larger ranges) to begin
+        T* mid = begin + size / 2;
+        if (size > SORT_NINTHER_THRESHOLD)
+        {
+            sort_order3(begin, mid, end - 1, less);
+            sort_order3(begin + 1, mid - 1, end - 2, less);
+            sort_order3(begin + 2, mid + 1, end - 3, less);
+            sort_order3(mid - 1, mid, mid + 1, less);
+            sort_swapkeys(begin, mid);
+        }
+        else
+        {
+            sort_order3(mid, begin, end - 1, less);
+        }
+
+        // elements of this range are all >= the one before it, so if the pivot equals that element, the elements equal
+        // to the pivot are already in their final place once partitioned to the left; this keeps many duplicates linear
+        if (!leftmost && !less(*(begin - 1), *begin))
+        {
+            begin = sort_partitionkeys<T, Less, true>(begin, end, less);
+            continue;
+        }
+
+        T* pivot = sort_partitionkeys<T, Less, false>(begin, end, less);
+
+        // sort smaller half recursively; the larger half is sorted in the next loop iteration
+        if (pivot - begin < end - pivot)
+        {
+            sort_keys(begin, pivot, limit, leftmost, less);
+            begin = pivot + 1;
+            leftmost = false;
+        }
+        else
+        {
+            sort_keys(pivot + 1, end, limit, false, less);
+            end = pivot;
+        }
+    }
+}
+
+static int sort_limit(int n)
+{
+    int limit = 0;
+    for (; n > 1; n >>= 1)
+        limit += 2;
+    return limit;
+}
+
+static bool sort_typed(lua_State* L, LuaTable* t, int n)
+{
+    if (n < 2 || n > t->sizearray)
+        return false;
+
+    TValue* arr = t->array;
+
+    if (ttisnumber(&arr[0]))
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            if (!ttisnumber(&arr[i]))
+                return false;
+
+            double v = nvalue(&arr[i]);
+            if (v != v || (v == 0 && signbit(v)))
+                return false;
+        }
+
+        double* keys = luaM_newarray(L, n, double, L->activememcat);
+        for (int i = 0; i < n; ++i)
+            keys[i] = nvalue(&arr[i]);
+
+        sort_keys(keys, keys + n, sort_limit(n), true, SortNumberLess());
+
+        for (int i = 0; i < n; ++i)
+            setnvalue(&arr[i], keys[i]);
+        luaM_freearray(L, keys, n, double, L->activememcat);
+        return true;
+    }
+
+    if (ttisstring(&arr[0]))
+    {
+        for (int i = 0; i < n; ++i)
+            if (!ttisstring(&arr[i]))
+                return false;
+
+        // the strings stay referenced from the table and nothing is allocated until they are written back
+        TString** keys = luaM_newarray(L, n, TString*, L->activememcat);
+        for (int i = 0; i < n; ++i)
+            keys[i] = tsvalue(&arr[i]);
+
+        sort_keys(keys, keys + n, sort_limit(n), true, SortStringLess());
+
+        // no barrier required because the same strings are in the array before and after
+        for (int i = 0; i < n; ++i)
+            setsvalue(L, &arr[i], keys[i]);
+        luaM_freearray(L, keys, n, TString*, L->activememcat);
+        return true;
+    }
+
+    return false;
+}
+
 static int tsort(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TTABLE);
@@ -488,6 +721,9 @@ static int tsort(lua_State* L)
     }
     lua_settop(L, 2); // make sure there are two arguments
 
+    if (pred == luaV_lessthan && sort_typed(L, t, n))
+        return 0;
+
     if (n > 0)
         sort_rec(L, t, 0, n - 1, n, pred);
     return 0;
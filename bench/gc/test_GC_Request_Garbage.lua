@@ -0,0 +1,34 @@
+local function prequire(name) local success, result = pcall(require, name); return success and result end
+local bench = script and require(script.Parent.bench_support) or prequire("bench_support") or require("../bench_support")
+
+-- a large long-lived heap, like a script environment or a registry, and request handlers that only allocate short-lived garbage
+local env = {}
+
+for i = 1,50000 do
+    env["key" .. i] = { id = i, name = "entry" .. i, tags = { i, i * 2, i * 3 } }
+end
+
+local function request(n)
+    local parts = {}
+
+    for i = 1,50 do
+        local entry = env["key" .. ((n * 31 + i) % 50000 + 1)]
+        parts[i] = { entry.id, entry.name .. ":" .. n }
+    end
+
+    return #parts
+end
+
+local function test()
+    for n = 1,4000 do
+        request(n)
+    end
+end
+
+bench.runCode(test, "GC: request garbage over a stable heap")
+
+-- generational mode only marks the young objects (and the old ones that changed) in most cycles
+if pcall(collectgarbage, "generational") then
+    bench.runCode(test, "GC: request garbage over a stable heap (generational)")
+    collectgarbage("incremental")
+end
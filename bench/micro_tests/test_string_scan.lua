@@ -0,0 +1,38 @@
+local function prequire(name) local success, result = pcall(require, name); return success and result end
+local bench = script and require(script.Parent.bench_support) or prequire("bench_support") or require("../bench_support")
+
+-- byte scanning primitives over 1KB, 64KB and 1MB strings, each case touches ~32MB in total
+local sizes = { { "1KB", 1024 }, { "64KB", 65536 }, { "1MB", 1048576 } }
+
+for _, size in sizes do
+	local name, len = size[1], size[2]
+	local text = string.sub(string.rep("The quick brown fox jumps over the lazy dog, ", len // 45 + 1), 1, len)
+	local needle = "lazy cat"
+	local csv = string.sub(string.rep("alpha,beta,gamma,delta,epsilon,", len // 31 + 1), 1, len)
+	local reps = 32768 // (len // 1024)
+
+	bench.runCode(function()
+		for i = 1, reps do
+			string.find(text, needle, 1, true)
+		end
+	end, "string: find plain miss (" .. name .. ")")
+
+	bench.runCode(function()
+		for i = 1, reps do
+			string.find(text, "%d")
+		end
+	end, "string: find pattern miss (" .. name .. ")")
+
+	bench.runCode(function()
+		for i = 1, reps do
+			string.lower(text)
+			string.upper(text)
+		end
+	end, "string: lower/upper (" .. name .. ")")
+
+	bench.runCode(function()
+		for i = 1, reps // 8 do
+			string.split(csv, ",")
+		end
+	end, "string: split (" .. name .. ")")
+end
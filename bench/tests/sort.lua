@@ -0,0 +1,28 @@
+local function prequire(name) local success, result = pcall(require, name); return success and result end
+local bench = script and require(script.Parent.bench_support) or prequire("bench_support") or require("../bench_support")
+
+function test()
+
+  -- table.sort without a comparator on 1M numbers and 200K strings, timed without the setup
+  local n = 1000000
+  local numbers = table.create(n)
+  local strings = table.create(n / 5)
+
+  math.randomseed(42)
+  for i = 1, n do
+    numbers[i] = math.random()
+  end
+  for i = 1, n / 5 do
+    strings[i] = "key" .. math.random(1, 1e9)
+  end
+
+  local ts0 = os.clock()
+  table.sort(numbers)
+  table.sort(strings)
+  local ts1 = os.clock()
+
+  assert(numbers[1] <= numbers[n] and strings[1] <= strings[n / 5])
+  return ts1 - ts0
+end
+
+bench.runCode(test, "sort")
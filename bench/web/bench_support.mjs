@@ -0,0 +1,143 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// minimal host for driving Luau.Web.* builds from node, mirrors what the luau-web wrapper sets up per state
+import { pathToFileURL } from "node:url";
+import path from "node:path";
+import { readFile } from "node:fs/promises";
+
+// moduleArgs go to the emscripten factory, e.g. { wasmModule } to start a .Wasm build from an already compiled module
+export async function loadModule(modulePath, options = {}, moduleArgs = {}) {
+    const factory = (await import(pathToFileURL(path.resolve(modulePath)).href)).default;
+    const Module = await factory(moduleArgs);
+
+    Module.LUA_VALUE = Symbol("LuaValue");
+    Module.JS_VALUE = Symbol("JsValue");
+    Module.JS_MUTABLE = Symbol("JsMutable");
+    Module.states = {};
+    Module.options = new Map(Object.entries(options));
+    Module.nextEnvId = 1;
+
+    return Module;
+}
+
+export async function createState(Module, globals = {}) {
+    const envId = Module.nextEnvId++;
+
+    // makeLuaState sets up Module.states[envId] through Module.createInteropState
+    const L = await Module.ccall("makeLuaState", "number", [ "number" ], [ envId ], { async: true });
+    const state = { Module, envId, L };
+
+    for (const [key, value] of Object.entries(globals)) {
+        setGlobal(state, key, value);
+    }
+
+    return state;
+}
+
+export function closeState(state) {
+    state.Module.ccall("luauClose", null, [ "number" ], [ state.L ]);
+    delete state.Module.states[state.envId];
+}
+
+export function setGlobal(state, key, value) {
+    state.Module.setLuaGlobal(state.envId, key, value);
+}
+
+function pushTransaction(state, value) {
+    const tx = state.Module.states[state.envId];
+    const key = tx.nextTXKey++;
+    tx.transactionData[key] = value;
+    return key;
+}
+
+function popLuaValue(state) {
+    return state.Module.popLuaValue(state.envId, state.L);
+}
+
+// compiles and loads source, returning the chunk as a callable LuaValue
+export function loadChunk(state, source, chunkName = "=bench") {
+    const status = state.Module.ccall("luauLoad", "number", [ "number", "number", "number" ], [
+        state.L, pushTransaction(state, source), pushTransaction(state, chunkName)
+    ]);
+
+    const value = popLuaValue(state);
+    if (status != 0) {
+        throw new Error("failed to load " + chunkName + ": " + value);
+    }
+
+    return value;
+}
+
+// loads precompiled bytecode (a Uint8Array), returning the chunk as a callable LuaValue
+export function loadBytecode(state, bytecode, chunkName = "=bench") {
+    const ptr = state.Module._malloc(bytecode.length);
+    state.Module.HEAPU8.set(bytecode, ptr);
+
+    const status = state.Module.ccall("luauLoadBytecode", "number", [ "number", "number", "number", "number" ], [
+        state.L, ptr, bytecode.length, pushTransaction(state, chunkName)
+    ]);
+    state.Module._free(ptr);
+
+    const value = popLuaValue(state);
+    if (status != 0) {
+        throw new Error("failed to load " + chunkName + ": " + value);
+    }
+
+    return value;
+}
+
+// compiles the .wasm emitted next to a Luau.Web.*.Wasm.js build, the result can be posted to workers
+export async function compileWasm(modulePath) {
+    const wasmPath = path.resolve(modulePath).replace(/\.js$/, ".wasm");
+    return WebAssembly.compile(await readFile(wasmPath));
+}
+
+// evaluates source and returns the first value it returns
+export async function evaluate(state, source, chunkName) {
+    const [result] = await loadChunk(state, source, chunkName)();
+    return result;
+}
+
+// runs fn repeatedly for at least minTime seconds and reports the best ops/sec across runs
+export async function measure(name, fn, { runs = 5, minTime = 0.2, opsPerCall = 1 } = {}) {
+    // warmup
+    await fn();
+
+    let best = 0;
+    let total = 0;
+    const samples = [];
+
+    for (let run = 0; run < runs; run++) {
+        let calls = 0;
+        const start = process.hrtime.bigint();
+        let elapsed = 0;
+
+        while (elapsed < minTime) {
+            await fn();
+            calls++;
+            elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+        }
+
+        const opsPerSec = (calls * opsPerCall) / elapsed;
+        samples.push(elapsed / (calls * opsPerCall));
+        best = Math.max(best, opsPerSec);
+        total += opsPerSec;
+    }
+
+    return { name, opsPerSec: best, avgOpsPerSec: total / runs, samples };
+}
+
+// lua allocations per operation, counted by the web build allocator over a fixed number of calls
+export async function countAllocations(Module, fn, { calls = 100, opsPerCall = 1 } = {}) {
+    const before = Module._getAllocationCount();
+    for (let i = 0; i < calls; i++) {
+        await fn();
+    }
+
+    return (Module._getAllocationCount() - before) / (calls * opsPerCall);
+}
+
+export function formatOps(value) {
+    if (value >= 1e6) return (value / 1e6).toFixed(2) + "M";
+    if (value >= 1e3) return (value / 1e3).toFixed(2) + "K";
+    return value.toFixed(2);
+}
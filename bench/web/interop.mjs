@@ -0,0 +1,218 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// interop microbenchmarks for the web builds, results can be compared with bench.py --results or sent to influx
+// usage: node bench/web/interop.mjs [--filter <substring>] [--filename <results name>] <Luau.Web.*.js>...
+import path from "node:path";
+import { writeFileSync } from "node:fs";
+import { loadModule, createState, closeState, loadChunk, evaluate, measure, countAllocations, formatOps } from "./bench_support.mjs";
+
+const N = 1000;
+
+const hostObject = { x: 1, y: 2, name: "host" };
+const frozenObject = Object.freeze({ x: 1, y: 2, name: "frozen" });
+const iterObject = Object.fromEntries(Array.from({ length: 16 }, (_, i) => [ "key" + i, i ]));
+const iterMap = new Map(Array.from({ length: 10000 }, (_, i) => [ "key" + i, i ]));
+const iterArray = new Float64Array(10000);
+const sequence = Array.from({ length: 100 }, (_, i) => i);
+
+const cases = [
+    {
+        name: "js->lua call, 0 args",
+        source: `return function() end`,
+        run: (fn) => fn(),
+    },
+    {
+        name: "js->lua call, 1 arg",
+        source: `return function(a) return a end`,
+        run: (fn) => fn(1),
+    },
+    {
+        name: "js->lua call, 8 args",
+        source: `return function(...) return select("#", ...) end`,
+        run: (fn) => fn(1, 2, 3, 4, "five", "six", true, false),
+    },
+    {
+        name: "js->lua indexLuaTable, string key",
+        source: `return { name = "lua", x = 1 }`,
+        run: (t) => {
+            for (let i = 0; i < N; i++) {
+                t.get("name");
+            }
+        },
+        opsPerCall: N,
+    },
+    {
+        name: "js->lua newIndexLuaTable, string key",
+        source: `return {}`,
+        run: (t) => {
+            for (let i = 0; i < N; i++) {
+                t.set("name", i);
+            }
+        },
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js proxy_call",
+        source: `local hostCall = hostCall
+            return function(n) for i = 1, n do hostCall(i) end end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        // only thenable results suspend, the gap to the sync case is the per-call asyncify/jspi cost
+        name: "lua->js proxy_call, promise result",
+        source: `local hostAsync = hostAsync
+            return function(n) for i = 1, n do hostAsync(i) end end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js proxy_call, promise result, cooperative",
+        options: { LUA_COOPERATIVE_SCHEDULER: true },
+        source: `local hostAsync = hostAsync
+            return function(n) for i = 1, n do hostAsync(i) end end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js proxy_index",
+        source: `local hostObject = hostObject
+            return function(n) local s = 0 for i = 1, n do s += hostObject.x end return s end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js proxy_index, frozen + LUA_PROPERTY_CACHE",
+        options: { LUA_PROPERTY_CACHE: true },
+        source: `local frozenObject = frozenObject
+            return function(n) local s = 0 for i = 1, n do s += frozenObject.x end return s end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js proxy_iter, 16 keys",
+        source: `local iterObject = iterObject
+            return function(n) for i = 1, n do for k, v in iterObject do end end end`,
+        run: (fn) => fn(10),
+        opsPerCall: 10,
+    },
+    {
+        name: "lua->js proxy_iter, Map of 10000",
+        source: `local iterMap = iterMap
+            return function() for k, v in iterMap do end end`,
+        run: (fn) => fn(),
+        opsPerCall: 10000,
+    },
+    {
+        name: "lua->js proxy_iter, Float64Array of 10000",
+        source: `local iterArray = iterArray
+            return function() for k, v in iterArray do end end`,
+        run: (fn) => fn(),
+        opsPerCall: 10000,
+    },
+    {
+        name: "lua->js proxy_iter, Float64Array of 10000, typed keys",
+        options: { LUA_TYPED_ITER_KEYS: true },
+        source: `local iterArray = iterArray
+            return function() for k, v in iterArray do end end`,
+        run: (fn) => fn(),
+        opsPerCall: 10000,
+    },
+    {
+        name: "lua->js implicit array, 100 items",
+        options: { LUA_IMPLICIT_ARRAYS_TO_JS_ARRAYS: true },
+        source: `local hostCall = hostCall
+            local t = table.create(100, 1)
+            return function(n) for i = 1, n do hostCall(t) end end`,
+        run: (fn) => fn(100),
+        opsPerCall: 100,
+    },
+    {
+        name: "js->lua array argument, 100 items",
+        options: { LUA_IMPLICIT_ARRAYS_TO_JS_ARRAYS: true },
+        source: `return function(t) return #t end`,
+        run: (fn) => fn(sequence),
+    },
+    {
+        name: "makeLuaState + luauClose",
+        run: async (_, Module) => closeState(await createState(Module)),
+    },
+    {
+        name: "makeLuaState (template) + luauClose",
+        options: { LUA_TEMPLATE_STATE: true },
+        run: async (_, Module) => closeState(await createState(Module)),
+    },
+    {
+        name: "luauLoad, cached",
+        run: (_, Module, state) => loadChunk(state, "local t = {} for i = 1, 10 do t[i] = i end return t"),
+    },
+    {
+        name: "luauLoad, uncached",
+        options: { LUA_BYTECODE_CACHE_SIZE: 0 },
+        run: (_, Module, state) => loadChunk(state, "local t = {} for i = 1, 10 do t[i] = i end return t"),
+    },
+];
+
+const args = process.argv.slice(2);
+let filter = null;
+let filename = null;
+const modulePaths = [];
+
+for (let i = 0; i < args.length; i++) {
+    if (args[i] == "--filter") {
+        filter = args[++i];
+    } else if (args[i] == "--filename") {
+        filename = args[++i];
+    } else {
+        modulePaths.push(args[i]);
+    }
+}
+
+if (modulePaths.length == 0) {
+    console.error("usage: node bench/web/interop.mjs [--filter <substring>] [--filename <results name>] <Luau.Web.*.js>...");
+    process.exit(1);
+}
+
+// same layout as bench.py result files: one list per test, one [filename, vm, shortVm, name, values, count] entry per vm
+const allResults = [];
+
+for (const benchCase of cases) {
+    if (filter && !benchCase.name.includes(filter)) {
+        continue;
+    }
+
+    const runs = [];
+
+    for (const modulePath of modulePaths) {
+        const Module = await loadModule(modulePath, benchCase.options);
+        const state = await createState(Module, {
+            hostCall: (...args) => args.length,
+            hostAsync: async (...args) => args.length,
+            hostObject,
+            frozenObject,
+            iterObject,
+            iterMap,
+            iterArray,
+        });
+
+        const fn = benchCase.source ? await evaluate(state, benchCase.source, "=" + benchCase.name) : null;
+        const run = () => benchCase.run(fn, Module, state);
+        const opsPerCall = benchCase.opsPerCall ?? 1;
+
+        const result = await measure(benchCase.name, run, { opsPerCall });
+        const allocs = await countAllocations(Module, run, { opsPerCall });
+
+        const vm = path.basename(modulePath, ".js");
+        console.log(benchCase.name.padEnd(40) + vm.padEnd(20) + (formatOps(result.opsPerSec) + " ops/s").padStart(16) + (allocs.toFixed(2) + " allocs/op").padStart(20));
+
+        // bench.py stores run times in ms
+        runs.push([ "web/interop.mjs", modulePath, vm, benchCase.name, result.samples.map(seconds => seconds * 1000), result.samples.length ]);
+
+        closeState(state);
+    }
+
+    allResults.push(runs);
+}
+
+if (filename) {
+    writeFileSync(filename + ".json", JSON.stringify(allResults));
+}
@@ -0,0 +1,69 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// compares the binary value abi against LUA_JSON_MARSHALLING
+// usage: node bench/web/marshal.mjs <path to Luau.Web.JSPI.js or Luau.Web.Asyncify.js>
+import { loadModule, createState, evaluate, measure, formatOps } from "./bench_support.mjs";
+
+const modulePath = process.argv[2];
+if (!modulePath) {
+    console.error("usage: node bench/web/marshal.mjs <path to Luau.Web.*.js>");
+    process.exit(1);
+}
+
+const N = 1000;
+
+const cases = [
+    {
+        name: "lua->js call, 4 mixed args",
+        source: `local hostEcho = hostEcho
+            return function(n) for i = 1, n do hostEcho(1, "two", true, 4.5) end end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js call, 8 number results",
+        source: `local hostNumbers = hostNumbers
+            return function(n) for i = 1, n do hostNumbers() end end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "lua->js call, long string",
+        source: `local hostEcho = hostEcho
+            local s = string.rep("luau", 256)
+            return function(n) for i = 1, n do hostEcho(s) end end`,
+        run: (fn) => fn(N),
+        opsPerCall: N,
+    },
+    {
+        name: "js->lua call, 4 mixed args",
+        source: `return function(...) return ... end`,
+        run: (fn) => fn(1, "two", true, 4.5),
+        opsPerCall: 1,
+    },
+];
+
+const results = {};
+
+for (const mode of [ "json", "binary" ]) {
+    const Module = await loadModule(modulePath, { LUA_JSON_MARSHALLING: mode == "json" });
+    const state = await createState(Module, {
+        hostEcho: (...args) => args,
+        hostNumbers: () => [ 1, 2, 3, 4, 5, 6, 7, 8 ],
+    });
+
+    for (const benchCase of cases) {
+        const fn = await evaluate(state, benchCase.source, "=" + benchCase.name);
+        const result = await measure(benchCase.name, () => benchCase.run(fn), { opsPerCall: benchCase.opsPerCall });
+        (results[benchCase.name] ??= {})[mode] = result.opsPerSec;
+    }
+}
+
+console.log("case".padEnd(36) + "json".padStart(12) + "binary".padStart(12) + "speedup".padStart(10));
+for (const [name, result] of Object.entries(results)) {
+    console.log(
+        name.padEnd(36) +
+        (formatOps(result.json) + "/s").padStart(12) +
+        (formatOps(result.binary) + "/s").padStart(12) +
+        ((result.binary / result.json).toFixed(2) + "x").padStart(10)
+    );
+}
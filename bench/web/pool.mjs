@@ -0,0 +1,63 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// throughput of a cpu bound script spread over LuauPool workers, for checking that it scales with the worker count
+// usage: node bench/web/pool.mjs <path to Luau.Web.*.js>
+import os from "node:os";
+import { LuauPool } from "../../CLI/src/WebPool.mjs";
+
+const modulePath = process.argv[2];
+if (!modulePath) {
+    console.error("usage: node bench/web/pool.mjs <path to Luau.Web.*.js>");
+    process.exit(1);
+}
+
+const source = `return function(n)
+    local sum = 0
+    for i = 1, n do
+        sum += math.sqrt(i) % 7
+    end
+    return sum
+end`;
+
+const STATES_PER_WORKER = 4;
+const CALLS_PER_STATE = 16;
+const ITERATIONS = 200000;
+
+const maxWorkers = os.availableParallelism();
+const workerCounts = [];
+for (let count = 1; count < maxWorkers; count *= 2) {
+    workerCounts.push(count);
+}
+workerCounts.push(maxWorkers);
+
+let baseline = 0;
+
+console.log("workers".padEnd(10) + "calls/s".padStart(12) + "scaling".padStart(10));
+for (const workers of workerCounts) {
+    const pool = await LuauPool.create(modulePath, { workers });
+
+    const states = [];
+    const functions = [];
+    for (let i = 0; i < workers * STATES_PER_WORKER; i++) {
+        const state = await pool.createState();
+        const [fn] = await (await state.load(source, "=pool")).call();
+        states.push(state);
+        functions.push(fn);
+    }
+
+    // warmup
+    await Promise.all(functions.map((fn) => fn.call(ITERATIONS)));
+
+    const start = performance.now();
+    await Promise.all(functions.map(async (fn) => {
+        for (let i = 0; i < CALLS_PER_STATE; i++) {
+            await fn.call(ITERATIONS);
+        }
+    }));
+    const callsPerSec = (functions.length * CALLS_PER_STATE) / ((performance.now() - start) / 1000);
+
+    baseline ||= callsPerSec;
+    console.log(String(workers).padEnd(10) + callsPerSec.toFixed(1).padStart(12) + ((callsPerSec / baseline).toFixed(2) + "x").padStart(10));
+
+    await Promise.all(states.map((state) => state.close()));
+    await pool.close();
+}
@@ -0,0 +1,34 @@
+#!/usr/bin/python3
+# This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+# reports bench/web/interop.mjs results through influxbench, the same way bench.py reports script benchmarks
+import argparse
+import json
+import math
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), ".."))
+import influxbench
+
+argumentParser = argparse.ArgumentParser(description='Report web interop benchmark results to influx')
+argumentParser.add_argument('results', type=str, help='Results file written by interop.mjs --filename')
+argumentParser.add_argument('--report-metrics', dest='report_metrics', help='Send metrics about this session to InfluxDB URL upon completion.')
+argumentParser.add_argument('--print-influx-debugging', action='store_true', dest='print_influx_debugging', help="Print output to aid in debugging of influx metrics reporting.")
+
+def main():
+    args = argumentParser.parse_args()
+    reporter = influxbench.InfluxReporter(args)
+
+    with open(args.results) as resultsFile:
+        allResults = json.load(resultsFile)
+
+    for test in allResults:
+        for filename, vm, shortVm, name, values, count in test:
+            avg = sum(values) / count
+            stdDev = math.sqrt(sum((v - avg) ** 2 for v in values) / (count - 1)) if count > 1 else 0
+            reporter.report_result("web", name, filename, "SUCCESS", min(values), avg, max(values), stdDev, shortVm, vm)
+
+    reporter.flush(0)
+
+if __name__ == "__main__":
+    main()
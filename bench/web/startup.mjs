@@ -0,0 +1,59 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// cold start of the single file builds against the .Wasm builds, on the main thread and across a worker per core
+// usage: node bench/web/startup.mjs <path to Luau.Web.JSPI.js> <path to Luau.Web.JSPI.Wasm.js>
+import os from "node:os";
+import { Worker, isMainThread, parentPort, workerData } from "node:worker_threads";
+import { loadModule, createState, closeState, evaluate, compileWasm } from "./bench_support.mjs";
+
+// time until a worker has a module loaded and has run a script
+async function startup(modulePath, wasmModule) {
+    const start = performance.now();
+    const Module = await loadModule(modulePath, {}, wasmModule ? { wasmModule } : {});
+    const state = await createState(Module);
+    await evaluate(state, "return 1", "=startup");
+    closeState(state);
+    return performance.now() - start;
+}
+
+if (!isMainThread) {
+    parentPort.postMessage(await startup(workerData.modulePath, workerData.wasmModule));
+} else {
+    const [singleFilePath, wasmPath] = process.argv.slice(2);
+    if (!singleFilePath || !wasmPath) {
+        console.error("usage: node bench/web/startup.mjs <path to Luau.Web.*.js> <path to Luau.Web.*.Wasm.js>");
+        process.exit(1);
+    }
+
+    const workerCount = os.availableParallelism();
+
+    // wall time until every worker is ready, the shared mode compiles once here and posts the module to each worker
+    async function startWorkers(modulePath, shareModule) {
+        const start = performance.now();
+        const wasmModule = shareModule ? await compileWasm(modulePath) : undefined;
+
+        const times = await Promise.all(Array.from({ length: workerCount }, () => new Promise((resolve, reject) => {
+            const worker = new Worker(new URL(import.meta.url), { workerData: { modulePath, wasmModule } });
+            worker.once("message", (time) => {
+                worker.terminate();
+                resolve(time);
+            });
+            worker.once("error", reject);
+        })));
+
+        return { wall: performance.now() - start, slowest: Math.max(...times) };
+    }
+
+    const modes = [
+        { name: "single file", run: () => startWorkers(singleFilePath, false) },
+        { name: "wasm, compiled per worker", run: () => startWorkers(wasmPath, false) },
+        { name: "wasm, shared compiled module", run: () => startWorkers(wasmPath, true) },
+    ];
+
+    console.log("main thread: single file " + (await startup(singleFilePath)).toFixed(1) + "ms, wasm " + (await startup(wasmPath)).toFixed(1) + "ms");
+
+    console.log("mode".padEnd(32) + ("wall (" + workerCount + " workers)").padStart(22) + "slowest worker".padStart(18));
+    for (const mode of modes) {
+        const result = await mode.run();
+        console.log(mode.name.padEnd(32) + (result.wall.toFixed(1) + "ms").padStart(22) + (result.slowest.toFixed(1) + "ms").padStart(18));
+    }
+}
@@ -0,0 +1,58 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// compares standalone makeLuaState against sandboxes forked from the template state (LUA_TEMPLATE_STATE)
+// usage: node bench/web/state.mjs <path to Luau.Web.JSPI.js or Luau.Web.Asyncify.js>
+import { loadModule, createState, closeState, evaluate, measure, formatOps } from "./bench_support.mjs";
+
+const modulePath = process.argv[2];
+if (!modulePath) {
+    console.error("usage: node bench/web/state.mjs <path to Luau.Web.*.js>");
+    process.exit(1);
+}
+
+const cases = [
+    {
+        name: "create + close",
+        run: async (Module) => closeState(await createState(Module)),
+    },
+    {
+        name: "create + run script + close",
+        run: async (Module) => {
+            const state = await createState(Module, { input: 21 });
+            await evaluate(state, "return input * 2", "=script");
+            closeState(state);
+        },
+    },
+];
+
+const results = {};
+const memory = {};
+
+for (const mode of [ "standalone", "template" ]) {
+    const Module = await loadModule(modulePath, { LUA_TEMPLATE_STATE: mode == "template" });
+
+    for (const benchCase of cases) {
+        const result = await measure(benchCase.name, () => benchCase.run(Module));
+        (results[benchCase.name] ??= {})[mode] = result.opsPerSec;
+    }
+
+    // wasm heap growth for 1000 sandboxes kept alive at once
+    const before = Module.HEAPU8.length;
+    const states = [];
+    for (let i = 0; i < 1000; i++) {
+        states.push(await createState(Module));
+    }
+    memory[mode] = Module.HEAPU8.length - before;
+    states.forEach(closeState);
+}
+
+console.log("case".padEnd(36) + "standalone".padStart(14) + "template".padStart(14) + "speedup".padStart(10));
+for (const [name, result] of Object.entries(results)) {
+    console.log(
+        name.padEnd(36) +
+        (formatOps(result.standalone) + "/s").padStart(14) +
+        (formatOps(result.template) + "/s").padStart(14) +
+        ((result.template / result.standalone).toFixed(2) + "x").padStart(10)
+    );
+}
+
+console.log("heap growth for 1000 live sandboxes: standalone " + (memory.standalone >> 10) + "KB, template " + (memory.template >> 10) + "KB");
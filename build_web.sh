@@ -1,4 +1,6 @@
 emcmake cmake -B build_web -DLUAU_BUILD_WEB=ON -DCMAKE_BUILD_TYPE=Release \
   -DCMAKE_EXE_LINKER_FLAGS="-sSTACK_SIZE=1048576 -sENVIRONMENT=web,node"
 cmake --build build_web -j2 --target Luau.Web.JSPI
-cmake --build build_web -j2 --target Luau.Web.Asyncify
\ No newline at end of file
+cmake --build build_web -j2 --target Luau.Web.Asyncify
+cmake --build build_web -j2 --target Luau.Web.JSPI.Wasm
+cmake --build build_web -j2 --target Luau.Web.Asyncify.Wasm
@@ -20,9 +20,11 @@
 #include "ScopedFlags.h"
 #include "ConformanceIrHooks.h"
 
+#include <atomic>
 #include <cstdlib>
 #include <fstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <math.h>
 
@@ -67,9 +69,20 @@ static Luau::CodeGen::CompilationOptions defaultCodegenOptions()
 
 static int lua_collectgarbage(lua_State* L)
 {
-    static const char* const opts[] = {"stop", "restart", "collect", "count", "isrunning", "step", "setgoal", "setstepmul", "setstepsize", nullptr};
+    static const char* const opts[] = {
+        "stop", "restart", "collect", "count", "isrunning", "step", "setgoal", "setstepmul", "setstepsize", "generational", nullptr
+    };
     static const int optsnum[] = {
-        LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT, LUA_GCCOUNT, LUA_GCISRUNNING, LUA_GCSTEP, LUA_GCSETGOAL, LUA_GCSETSTEPMUL, LUA_GCSETSTEPSIZE
+        LUA_GCSTOP,
+        LUA_GCRESTART,
+        LUA_GCCOLLECT,
+        LUA_GCCOUNT,
+        LUA_GCISRUNNING,
+        LUA_GCSTEP,
+        LUA_GCSETGOAL,
+        LUA_GCSETSTEPMUL,
+        LUA_GCSETSTEPSIZE,
+        LUA_GCSETGENERATIONAL
     };
 
     int o = luaL_checkoption(L, 1, "collect", opts);
@@ -79,6 +92,7 @@ static int lua_collectgarbage(lua_State* L)
     {
     case LUA_GCSTEP:
     case LUA_GCISRUNNING:
+    case LUA_GCSETGENERATIONAL:
     {
         lua_pushboolean(L, res);
         return 1;
@@ -1006,6 +1020,143 @@ TEST_CASE("GC")
     );
 }
 
+TEST_CASE("GCGenerational")
+{
+    // closures, coroutines and table churn under minor cycles, with old objects keeping their marks in between
+    for (const char* name : {"closure.luau", "coroutine.luau", "sort.luau"})
+    {
+        runConformance(
+            name,
+            [](lua_State* L)
+            {
+                lua_gc(L, LUA_GCSETGENERATIONAL, 1);
+            }
+        );
+    }
+}
+
+TEST_CASE("GCBackgroundSweep")
+{
+    // pages emptied by the sweep come back through the helper thread for reuse while the scripts keep allocating
+    for (const char* name : {"closure.luau", "coroutine.luau", "sort.luau"})
+    {
+        runConformance(
+            name,
+            [](lua_State* L)
+            {
+                lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 1);
+            }
+        );
+    }
+
+    StateRef globalState(luaL_newstate(), lua_close);
+    lua_State* L = globalState.get();
+
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 1) == 0);
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 1) == 1);
+
+    // stopping hands all memory back to the allocator, and the state keeps working without the helper
+    for (int i = 0; i < 10000; ++i)
+    {
+        lua_createtable(L, 100, 0);
+        lua_pop(L, 1);
+    }
+
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 0) == 1);
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 0) == 0);
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        lua_createtable(L, 100, 0);
+        lua_pop(L, 1);
+    }
+
+    lua_gc(L, LUA_GCCOLLECT, 0);
+}
+
+static std::thread::id sweeperTestMainThread;
+static std::atomic<int> sweeperTestInlineLargeFrees;
+
+static void* sweeperTestRealloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    if (nsize == 0)
+    {
+        if (ptr && osize > 1024 && std::this_thread::get_id() == sweeperTestMainThread)
+            sweeperTestInlineLargeFrees++;
+
+        free(ptr);
+        return nullptr;
+    }
+
+    return realloc(ptr, nsize);
+}
+
+TEST_CASE("GCBackgroundSweepLargeBlocks")
+{
+    sweeperTestMainThread = std::this_thread::get_id();
+
+    StateRef globalState(lua_newstate(sweeperTestRealloc, nullptr), lua_close);
+    lua_State* L = globalState.get();
+
+    luaL_openlibs(L);
+    REQUIRE(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 1) == 0);
+    sweeperTestInlineLargeFrees = 0;
+
+    // large arrays that are freed, shrunk into a small size class, shrunk to nothing or swept all go to the helper thread
+    const char* source = R"(
+        for i = 1, 100 do
+            local t = table.create(200, 1)
+            for j = 11, 200 do t[j] = nil end
+            t.x = 1
+
+            local u = table.create(200, 1)
+            for j = 1, 200 do u[j] = nil end
+            u.x = 1
+
+            local v = table.create(200, 1)
+        end
+    )";
+
+    size_t bytecodeSize = 0;
+    char* bytecode = luau_compile(source, strlen(source), nullptr, &bytecodeSize);
+    REQUIRE(luau_load(L, "=GCBackgroundSweepLargeBlocks", bytecode, bytecodeSize, 0) == 0);
+    free(bytecode);
+
+    REQUIRE(lua_pcall(L, 0, 0, 0) == LUA_OK);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+
+    CHECK(sweeperTestInlineLargeFrees == 0);
+}
+
+static bool sweeperTestFailAllocations;
+
+static void* sweeperTestFailingRealloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    if (nsize == 0)
+    {
+        free(ptr);
+        return nullptr;
+    }
+
+    return sweeperTestFailAllocations ? nullptr : realloc(ptr, nsize);
+}
+
+TEST_CASE("GCBackgroundSweepStartFailure")
+{
+    StateRef globalState(lua_newstate(sweeperTestFailingRealloc, nullptr), lua_close);
+    lua_State* L = globalState.get();
+
+    // a sweeper that can't be allocated is reported, and the collector keeps sweeping in the foreground
+    sweeperTestFailAllocations = true;
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 1) == -1);
+    sweeperTestFailAllocations = false;
+
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 0) == 0);
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 1) == 0);
+    CHECK(lua_gc(L, LUA_GCSETBACKGROUNDSWEEP, 0) == 1);
+}
+
 TEST_CASE("Bitwise")
 {
     runConformance("bitwise.luau");
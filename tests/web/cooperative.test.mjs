@@ -0,0 +1,50 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+import { test } from "node:test";
+import assert from "node:assert/strict";
+import { loadModule, withState, load, evaluate } from "./support.mjs";
+
+const boundaryError = /attempt to await a js promise across a metamethod\/C-call boundary/;
+
+async function withCooperativeState(fn) {
+    const Module = await loadModule({ LUA_COOPERATIVE_SCHEDULER: true });
+    return withState(Module, { wait: (value) => Promise.resolve(value) }, fn);
+}
+
+test("await on the call thread yields", async () => {
+    await withCooperativeState(async (state) => {
+        assert.equal(await evaluate(state, `return wait(42)`), 42);
+    });
+});
+
+test("await inside __index raises", async () => {
+    await withCooperativeState(async (state) => {
+        const chunk = load(state, `
+            local t = setmetatable({}, { __index = function(_, key) return wait(key) end })
+            return t.x
+        `);
+        await assert.rejects(chunk(), boundaryError);
+    });
+});
+
+test("await inside coroutine.wrap raises", async () => {
+    await withCooperativeState(async (state) => {
+        const chunk = load(state, `
+            local co = coroutine.wrap(function() return wait(1) end)
+            return co()
+        `);
+        await assert.rejects(chunk(), boundaryError);
+    });
+});
+
+test("state keeps running after a refused await", async () => {
+    await withCooperativeState(async (state) => {
+        const ok = await evaluate(state, `
+            return pcall(function()
+                return setmetatable({}, { __index = function() return wait(1) end }).x
+            end)
+        `);
+        assert.equal(ok, false);
+
+        assert.equal(await evaluate(state, `return wait("after")`), "after");
+    });
+});
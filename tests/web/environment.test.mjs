@@ -0,0 +1,55 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+import { test } from "node:test";
+import assert from "node:assert/strict";
+import { loadModule, withState, evaluate } from "./support.mjs";
+
+function installAndRead(Module, env, options) {
+    return withState(Module, {}, async (state) => {
+        Module.installEnvironment(state.envId, env, options);
+        return evaluate(state, `return answer`);
+    });
+}
+
+test("environments are not shared without a cacheKey", async () => {
+    const Module = await loadModule({ LUA_TEMPLATE_STATE: true });
+    const env = { answer: 1 };
+
+    assert.equal(await installAndRead(Module, env, { freeze: true }), 1);
+
+    env.answer = 2;
+    assert.equal(await installAndRead(Module, env, { freeze: true }), 2);
+    assert.equal(Module.environmentCache.size, 0);
+});
+
+test("cacheKey shares the table until it is released", async () => {
+    const Module = await loadModule({ LUA_TEMPLATE_STATE: true });
+    const env = { answer: 1 };
+
+    assert.equal(await installAndRead(Module, env, { cacheKey: "host" }), 1);
+
+    env.answer = 2;
+    assert.equal(await installAndRead(Module, env, { cacheKey: "host" }), 1);
+
+    assert.equal(Module.releaseEnvironment("host"), true);
+    assert.equal(Module.releaseEnvironment("host"), false);
+    assert.equal(Module.environmentCache.size, 0);
+
+    assert.equal(await installAndRead(Module, env, { cacheKey: "host" }), 2);
+});
+
+test("keys without ids keep the fallback table, freeze and cacheKey", async () => {
+    const Module = await loadModule({ LUA_TEMPLATE_STATE: true, LUA_JSON_MARSHALLING: true });
+    const env = { answer: 1 };
+
+    assert.equal(await installAndRead(Module, env, { cacheKey: "json" }), 1);
+    env.answer = 2;
+    assert.equal(await installAndRead(Module, env, { cacheKey: "json" }), 1);
+
+    await withState(Module, {}, async (state) => {
+        Module.installEnvironment(state.envId, { answer: 3 }, { freeze: true });
+
+        // the env sits behind the sandbox globals, so a script global shadows it and the table itself is frozen
+        assert.equal(await evaluate(state, `answer = 4 return answer`), 4);
+        assert.equal(await evaluate(state, `return pcall(function() getmetatable(_G).__index.answer = 5 end)`), false);
+    });
+});
@@ -0,0 +1,36 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+import { test } from "node:test";
+import assert from "node:assert/strict";
+import { loadModule, withState, evaluate } from "./support.mjs";
+
+// "type(key)=value" for every pair the loop yields, in order
+const collect = `return function(value)
+    local out = {}
+    for k, v in value do
+        table.insert(out, type(k) .. "(" .. tostring(k) .. ")=" .. tostring(v))
+    end
+    return table.concat(out, " ")
+end`;
+
+async function iterate(options, value) {
+    return withState(await loadModule(options), {}, async (state) => {
+        const [result] = await (await evaluate(state, collect))(value);
+        return result;
+    });
+}
+
+test("iteration keeps string keys by default", async () => {
+    assert.equal(await iterate({}, [ "a", "b" ]), "string(0)=a string(1)=b");
+    assert.equal(await iterate({}, new Map([ [ 1, "a" ], [ "x", "b" ] ])), "string(1)=a string(x)=b");
+    assert.equal(await iterate({}, new Set([ "a" ])), "");
+    assert.equal(await iterate({}, { x: 1 }), "string(x)=1");
+});
+
+test("LUA_TYPED_ITER_KEYS yields typed keys", async () => {
+    const options = { LUA_TYPED_ITER_KEYS: true };
+
+    assert.equal(await iterate(options, [ "a", "b" ]), "number(0)=a number(1)=b");
+    assert.equal(await iterate(options, new Map([ [ 1, "a" ], [ "x", "b" ] ])), "number(1)=a string(x)=b");
+    assert.equal(await iterate(options, new Set([ "a" ])), "string(a)=true");
+    assert.equal(await iterate(options, { x: 1 }), "string(x)=1");
+});
@@ -0,0 +1,40 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+import { test } from "node:test";
+import assert from "node:assert/strict";
+import { loadModule, withState, load, evaluate } from "./support.mjs";
+
+const limit = 1 << 20;
+
+for (const template of [ false, true ]) {
+    const kind = template ? "forked sandbox" : "standalone state";
+
+    test(`single allocation past the limit fails in a ${kind}`, async () => {
+        const Module = await loadModule({ LUA_TEMPLATE_STATE: template, LUA_MEMORY_LIMIT: limit });
+
+        await withState(Module, {}, async (state) => {
+            for (const source of [ `string.rep("x", 2^24)`, `table.create(1e7, 0)`, `buffer.create(2^24)` ]) {
+                const [ok, err] = await load(state, `return pcall(function() return ${source} end)`)();
+                assert.equal(ok, false, source);
+                assert.match(String(err), /not enough memory/, source);
+            }
+
+            const stats = Module.memoryStats(state.envId);
+            assert.ok(stats.current <= limit, "current " + stats.current);
+            assert.ok(stats.peak <= limit, "peak " + stats.peak);
+
+            // the failed allocations leave the sandbox usable
+            assert.equal(await evaluate(state, `return #string.rep("x", 1000)`), 1000);
+        });
+    });
+}
+
+test("forked sandboxes are held to their own limits", async () => {
+    const Module = await loadModule({ LUA_TEMPLATE_STATE: true });
+
+    await withState(Module, {}, (limited) => withState(Module, {}, async (unlimited) => {
+        Module.setMemoryLimit(limited.envId, limit);
+
+        assert.equal(await evaluate(limited, `return (pcall(string.rep, "x", 2^21))`), false);
+        assert.equal(await evaluate(unlimited, `return #string.rep("x", 2^21)`), 2 ** 21);
+    }));
+});
@@ -0,0 +1,51 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+import { test } from "node:test";
+import assert from "node:assert/strict";
+import { LuauPool } from "../../CLI/src/WebPool.mjs";
+import { modulePath } from "./support.mjs";
+
+// the returned call waits on the host forever, so it is still pending when the worker goes away
+async function startHangingCall(pool) {
+    const state = await pool.createState({ hang: () => new Promise(() => {}) });
+    const [fn] = await (await state.load("return function() return hang() end")).call();
+
+    // the rejection arrives before the test awaits it, so it needs a handler right away
+    const pending = fn.call();
+    pending.catch(() => {});
+    return { state, pending };
+}
+
+test("a dead worker fails its pending requests and states", async () => {
+    const pool = await LuauPool.create(modulePath, { workers: 2 });
+
+    try {
+        const { state, pending } = await startHangingCall(pool);
+        const dead = state.worker;
+
+        await dead.worker.terminate();
+
+        await assert.rejects(pending, /worker exited/);
+        assert.equal(state.closed, true);
+        await assert.rejects(state.load("return 1"), /closed state/);
+
+        // new states only go to the worker that is left
+        for (let i = 0; i < 4; i++) {
+            const other = await pool.createState();
+            assert.notEqual(other.worker, dead);
+            await other.close();
+        }
+    } finally {
+        await pool.close();
+    }
+});
+
+test("closing the pool fails pending requests", async () => {
+    const pool = await LuauPool.create(modulePath, { workers: 1 });
+    const { state, pending } = await startHangingCall(pool);
+
+    await pool.close();
+
+    await assert.rejects(pending, /pool was closed/);
+    assert.equal(state.closed, true);
+    await assert.rejects(pool.createState(), /no live workers/);
+});
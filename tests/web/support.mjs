@@ -0,0 +1,79 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// fixtures for the web build tests, which run against a built Luau.Web.* module:
+//   LUAU_WEB_MODULE=<path to Luau.Web.JSPI.Wasm.js> node --experimental-wasm-jspi --test tests/web/
+import { pathToFileURL } from "node:url";
+import path from "node:path";
+
+if (!process.env.LUAU_WEB_MODULE) {
+    throw new Error("LUAU_WEB_MODULE must point at a Luau.Web.* build");
+}
+
+export const modulePath = path.resolve(process.env.LUAU_WEB_MODULE);
+
+// a fresh module instance per call, options are the Module.options the luau-web wrapper would pass
+export async function loadModule(options = {}) {
+    const factory = (await import(pathToFileURL(modulePath).href)).default;
+    const Module = await factory({});
+
+    Module.LUA_VALUE = Symbol("LuaValue");
+    Module.JS_VALUE = Symbol("JsValue");
+    Module.JS_MUTABLE = Symbol("JsMutable");
+    Module.options = new Map(Object.entries(options));
+    Module.nextEnvId = 1;
+
+    return Module;
+}
+
+export async function createState(Module, globals = {}) {
+    const envId = Module.nextEnvId++;
+    const L = await Module.ccall("makeLuaState", "number", [ "number" ], [ envId ], { async: true });
+
+    for (const [key, value] of Object.entries(globals)) {
+        Module.setLuaGlobal(envId, key, value);
+    }
+
+    return { Module, envId, L };
+}
+
+export function closeState(state) {
+    state.Module.ccall("luauClose", null, [ "number" ], [ state.L ]);
+    delete state.Module.states[state.envId];
+}
+
+// runs fn with a new state of Module and closes it afterwards
+export async function withState(Module, globals, fn) {
+    const state = await createState(Module, globals);
+
+    try {
+        return await fn(state);
+    } finally {
+        closeState(state);
+    }
+}
+
+function pushTransaction(state, value) {
+    const tx = state.Module.states[state.envId];
+    const key = tx.nextTXKey++;
+    tx.transactionData[key] = value;
+    return key;
+}
+
+// compiles and loads source, returning the chunk as a callable LuaValue
+export function load(state, source, chunkName = "=test") {
+    const status = state.Module.ccall("luauLoad", "number", [ "number", "number", "number" ], [
+        state.L, pushTransaction(state, source), pushTransaction(state, chunkName)
+    ]);
+
+    const value = state.Module.popLuaValue(state.envId, state.L);
+    if (status != 0) {
+        throw new Error("failed to load " + chunkName + ": " + value);
+    }
+
+    return value;
+}
+
+// runs source and returns the first value it returns
+export async function evaluate(state, source) {
+    const [result] = await load(state, source)();
+    return result;
+}